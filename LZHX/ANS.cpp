@@ -0,0 +1,294 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+// c++
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// LZHX
+#include "ANS.h"
+#include "Utils.h"
+
+using namespace LZHX;
+
+// bits needed for v, 0 for 0
+static inline int bitWidth(DWord v) {
+    if (v == 0) return 0;
+#ifdef _MSC_VER
+    unsigned long i; _BitScanReverse(&i, v); return int(i) + 1;
+#else
+    return 32 - __builtin_clz(v);
+#endif
+}
+
+// constructors/destructors
+ANS::ANS() {
+    bit_stream = new BitStream;
+    freq       = new int[256];
+    norm       = new int[256];
+    spread     = new Byte[ANSTBSIZE];
+    enc_tbl    = new Word[ANSTBSIZE];
+    enc_sym    = new ANSSymbol[256];
+    dec_tbl    = new ANSDecode[ANSTBSIZE];
+    chunks     = nullptr;
+    chunks_cap = 0;
+}
+ANS::~ANS() {
+    delete bit_stream;
+    delete[] freq;
+    delete[] norm;
+    delete[] spread;
+    delete[] enc_tbl;
+    delete[] enc_sym;
+    delete[] dec_tbl;
+    delete[] chunks;
+}
+
+// info
+CodecType ANS::getCodecType() { return CT_ANS; }
+int ANS::getTotalIn()         { return total_in;  }
+int ANS::getTotalOut()        { return total_out; }
+
+// init
+void ANS::initStream(CodecStream *cs) {
+    this->codec_stream = cs;
+    this->total_in     = this->total_out = 0;
+}
+
+// scale counts to ANSTBSIZE, every used symbol keeps at least one state;
+// rounding error goes to the most frequent symbol, if it can't take it
+// states are taken from the largest counts
+void ANS::normalize(int total) {
+    int sum(0), top(0);
+    for (int s = 0; s < 256; s++) {
+        norm[s] = 0;
+        if (freq[s] == 0) continue;
+        norm[s] = int((QWord(freq[s]) * ANSTBSIZE + total / 2) / total);
+        if (norm[s] == 0) norm[s] = 1;
+        if (freq[s] > freq[top]) top = s;
+        sum += norm[s];
+    }
+    if (norm[top] + ANSTBSIZE - sum > 0) {
+        norm[top] += ANSTBSIZE - sum;
+        return;
+    }
+    while (sum > ANSTBSIZE) {
+        int big = 0, d;
+        for (int s = 1; s < 256; s++) if (norm[s] > norm[big]) big = s;
+        d = norm[big] / 2 < sum - ANSTBSIZE ? norm[big] / 2 : sum - ANSTBSIZE;
+        norm[big] -= d;
+        sum       -= d;
+    }
+}
+
+// counts are written as their bit width on 4 bits and the rest of them
+// without top bit, width 0 is followed by 4 bit run of further zeros
+void ANS::writeCounts() {
+    for (int s = 0; s < 256; ) {
+        int nb = bitWidth(norm[s]), run = 0;
+        bit_stream->writeBits(nb, 4);
+        if (nb) {
+            bit_stream->writeBits(norm[s] - (1 << (nb - 1)), nb - 1);
+            s++;
+            continue;
+        }
+        while (run < 15 && s + 1 + run < 256 && norm[s + 1 + run] == 0) run++;
+        bit_stream->writeBits(run, 4);
+        s += 1 + run;
+    }
+}
+bool ANS::readCounts() {
+    int sum(0);
+    for (int s = 0; s < 256; ) {
+        int nb = bit_stream->readBits(4);
+        if (nb) {
+            sum += norm[s++] = (1 << (nb - 1)) + bit_stream->readBits(nb - 1);
+            continue;
+        }
+        for (int run = bit_stream->readBits(4) + 1; run > 0 && s < 256; run--) norm[s++] = 0;
+    }
+    return sum == ANSTBSIZE;
+}
+
+// states are assigned to symbols with odd step, so each symbol's states
+// are scattered over whole table
+void ANS::spreadSymbols() {
+    int pos(0), step = (ANSTBSIZE >> 1) + (ANSTBSIZE >> 3) + 3;
+    for (int s = 0; s < 256; s++) {
+        for (int i = 0; i < norm[s]; i++) {
+            spread[pos] = Byte(s);
+            pos = (pos + step) & ANSTBMASK;
+        }
+    }
+}
+
+// symbol with count n leaves state in [n, 2n) after writing its low bits,
+// encoding table maps it to the state which decodes to the symbol
+void ANS::buildEncoder() {
+    int cumul[256], c(0);
+    for (int s = 0; s < 256; s++) {
+        int n = norm[s], bits;
+        cumul[s] = c;
+        c += n;
+        if (n == 0) continue;
+        bits = n == 1 ? ANSTBLOG : ANSTBLOG - (bitWidth(n - 1) - 1);
+        enc_sym[s].delta_bits  = (bits << 16) - (n << bits);
+        enc_sym[s].delta_state = cumul[s] - n;
+    }
+    for (int u = 0; u < ANSTBSIZE; u++)
+        enc_tbl[cumul[spread[u]]++] = Word(ANSTBSIZE + u);
+}
+void ANS::buildDecoder() {
+    int next[256];
+    for (int s = 0; s < 256; s++) next[s] = norm[s];
+    for (int u = 0; u < ANSTBSIZE; u++) {
+        int s = spread[u], x = next[s]++, bits = ANSTBLOG - (bitWidth(x) - 1);
+        dec_tbl[u].sym  = Byte(s);
+        dec_tbl[u].bits = Byte(bits);
+        dec_tbl[u].next = Word((x << bits) - ANSTBSIZE);
+    }
+}
+
+// compress block
+int ANS::compressBlock() {
+    int in_size, nb;
+    DWord st[2] = { ANSTBSIZE, ANSTBSIZE };
+    CodecBuffer *cb_in, *cb_out;
+    Byte *in, *out;
+
+    // find one LZ stream and empty buffer for its code
+    cb_in        = codec_stream->find(CBT_LZ);
+    cb_out       = codec_stream->find(CBT_EMPTY);
+    cb_out->type = CBT_ANS;
+    in           = cb_in ->mem;
+    out          = cb_out->mem;
+    cb_in->type  = CBT_EMPTY;
+    in_size      = cb_in->size;
+
+    // write input size and normalized counts
+    bit_stream->assignBuffer(out, cb_out->cap);
+    bit_stream->writeBits(in_size, 32);
+    if (in_size > 0) {
+        countBytes(in, in_size, freq);
+        normalize(in_size);
+        writeCounts();
+        spreadSymbols();
+        buildEncoder();
+
+        // code symbols from the last one, bits each of them gives away
+        // are kept to be written in order
+        if (in_size > chunks_cap) {
+            delete[] chunks;
+            chunks     = new DWord[in_size];
+            chunks_cap = in_size;
+        }
+        for (int i = in_size - 1; i >= 0; i--) {
+            DWord &x = st[i & 1];
+            ANSSymbol *e = enc_sym + in[i];
+            nb = int((x + e->delta_bits) >> 16);
+            chunks[i] = (x & ((1 << nb) - 1)) | (nb << 16);
+            x = enc_tbl[int(x >> nb) + e->delta_state];
+        }
+
+        // final states are the first ones decoder reads
+        bit_stream->writeBits(st[0] - ANSTBSIZE, ANSTBLOG);
+        bit_stream->writeBits(st[1] - ANSTBSIZE, ANSTBLOG);
+        for (int i = 0; i < in_size; i++)
+            bit_stream->writeBits(chunks[i] & 0xFFFF, chunks[i] >> 16);
+    }
+
+    // close last byte with 0 bits, code which doesn't fit is reported at
+    // its full size, so stream is stored instead
+    bit_stream->flush();
+    if (bit_stream->isOverrun()) bit_stream->setBytePos(cb_out->cap);
+
+    // update info
+    total_in    += in_size;
+    total_out   += bit_stream->getBytePos();
+    cb_out->size = bit_stream->getBytePos();
+
+    return cb_out->size;
+}
+
+// decompress block, whole of it is pulled at once
+int ANS::decompressBlock() {
+    int o(0), n;
+    CodecBuffer *cb_in, *cb_out;
+
+    // find one ANS buffer and one empty
+    cb_in        = codec_stream->find(CBT_ANS);
+    cb_out       = codec_stream->find(CBT_EMPTY);
+    cb_out->type = CBT_LZ;
+    cb_in->type  = CBT_EMPTY;
+
+    openBlock(cb_in);
+    while ((n = pullSymbols(cb_out->mem + o)) > 0) o += n;
+    cb_out->size = o;
+
+    return o;
+}
+
+// open block for decoding - read decompressed size, counts and first
+// states, damaged counts give zeros
+int ANS::openBlock(CodecBuffer *cb_in) {
+    bit_stream->assignBuffer(cb_in->mem, cb_in->size);
+    dec_size = bit_stream->readBits(32);
+    dec_pos  = 0;
+    dec_bad  = dec_size > 0 && !readCounts();
+    if (dec_size > 0 && !dec_bad) {
+        spreadSymbols();
+        buildDecoder();
+        dec_x[0] = bit_stream->readBits(ANSTBLOG);
+        dec_x[1] = bit_stream->readBits(ANSTBLOG);
+    }
+    dec_bs = *bit_stream;
+
+    // update info
+    total_in  += cb_in->size;
+    total_out += dec_size;
+
+    return dec_size;
+}
+
+// decode next round of symbols, rounds are even so states keep turns
+int ANS::pullSymbols(Byte *out) {
+    int n, o(0), x0, x1;
+    ANSDecode *e0, *e1;
+    BitStream bs;
+
+    n = dec_size - dec_pos < CDCROUND ? dec_size - dec_pos : CDCROUND;
+    if (n <= 0) return 0;
+    dec_pos += n;
+    if (dec_bad) {
+        memset(out, 0, n);
+        return n;
+    }
+
+    // two states take turns, lookup of one doesn't wait for the other
+    // and bits of both come from one refill
+    bs = dec_bs;
+    x0 = dec_x[0];
+    x1 = dec_x[1];
+    for (; o + 1 < n; o += 2) {
+        e0 = dec_tbl + x0;
+        e1 = dec_tbl + x1;
+        bs.refill();
+        out[o]     = e0->sym;
+        out[o + 1] = e1->sym;
+        x0 = e0->next + int(bs.peekBits(e0->bits));
+        bs.consume(e0->bits);
+        x1 = e1->next + int(bs.peekBits(e1->bits));
+        bs.consume(e1->bits);
+    }
+    if (o < n) out[o++] = dec_tbl[x0].sym;
+    dec_bs   = bs;
+    dec_x[0] = x0;
+    dec_x[1] = x1;
+
+    return n;
+}
@@ -0,0 +1,77 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+#ifndef LZHX_ANS_H
+#define LZHX_ANS_H
+
+// LZHX
+#include "Types.h"
+#include "BitStream.h"
+
+// state table size, symbol counts are normalized to sum up to it
+#define ANSTBLOG  12
+#define ANSTBSIZE (1 << ANSTBLOG)
+#define ANSTBMASK (ANSTBSIZE - 1)
+
+namespace LZHX {
+
+// encoding transform of symbol - bits written for state and where its
+// states start in encoding table
+class ANSSymbol {
+public:
+    int delta_bits, delta_state;
+};
+
+// decoding table entry - symbol of state, bits read after it and base of
+// next state
+class ANSDecode {
+public:
+    Word next;
+    Byte sym;
+    Byte bits;
+};
+
+// table based asymmetric numeral system coder, fractional code lengths
+// suit skewed streams better than huffman; symbols are coded from the
+// last one, so decoder reads them in order, two states take turns
+class ANS : public CodecInterface {
+private:
+    int total_in, total_out;
+    CodecStream *codec_stream;
+    BitStream   *bit_stream;
+    int         *freq, *norm;
+    Byte        *spread;
+    Word        *enc_tbl;
+    ANSSymbol   *enc_sym;
+    ANSDecode   *dec_tbl;
+    DWord       *chunks;
+    int          chunks_cap;
+    // decoding state between pulls
+    BitStream    dec_bs;
+    int          dec_size, dec_pos, dec_x[2];
+    bool         dec_bad;
+    void normalize(int total);
+    void writeCounts();
+    bool readCounts();
+    void spreadSymbols();
+    void buildEncoder();
+    void buildDecoder();
+public:
+    ANS();
+    ~ANS();
+    CodecType getCodecType();
+    int  getTotalIn();
+    int  getTotalOut();
+    void initStream(CodecStream *codec_stream);
+    int  compressBlock();
+    int  decompressBlock();
+    int  openBlock(CodecBuffer *cb_in);
+    int  pullSymbols(Byte *out);
+};
+
+} // namespace
+
+#endif // LZHX_ANS_H
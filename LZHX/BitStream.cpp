@@ -9,36 +9,55 @@
 using namespace LZHX;
 
 // constructor/destructors
-BitStream::BitStream()                  { this->buf = nullptr; resetPos(); }
-void BitStream::assignBuffer(Byte *b)   { this->buf = b;     resetPos(); }
+BitStream::BitStream() { this->buf = nullptr; this->cap = 0; resetPos(); }
+void BitStream::assignBuffer(Byte *b, int c) {
+	this->buf = b;
+	this->cap = c;
+	resetPos();
+}
 
-// positioning
-int  BitStream::getBitPos ()  { return bit_pos;  }
-int  BitStream::getBytePos()  { return byte_pos; }
-void BitStream::setBitPos (int bp ) { this->bit_pos = bp; }
-void BitStream::setBytePos(int bp) { this->byte_pos = bp; }
-void BitStream::resetPos() { bit_pos = byte_pos = 0; }
+// positioning, reader's accumulator holds bits ahead of its position and
+// writer's the ones behind
+int BitStream::getBitPos() {
+	return (reading ? byte_pos * 8 - acc_bits : byte_pos * 8 + acc_bits) & 7;
+}
+int BitStream::getBytePos() {
+	return (reading ? byte_pos * 8 - acc_bits : byte_pos * 8 + acc_bits) >> 3;
+}
+void BitStream::setBytePos(int bp) {
+	this->byte_pos = bp;
+	acc = 0;
+	acc_bits = 0;
+}
+void BitStream::resetPos() {
+	byte_pos = acc_bits = 0;
+	acc      = 0;
+	reading  = overrun = false;
+}
+bool BitStream::isOverrun() { return overrun; }
 
 // writing
-void BitStream::writeBit(int bit) {
-	if (bit_pos == 0) { buf[byte_pos] = bit & 1; bit_pos++; }
-    else { buf[byte_pos] |= ((bit & 1) << bit_pos++); }
-	if (bit_pos > 7) { bit_pos = 0; byte_pos++; }
-}
-void BitStream::writeBits(int bits, int count) {
-    if (count == 8 && bit_pos == 0) { buf[byte_pos++] = Byte(bits); }
-    else { for (int i = 0; i < count; i++) { writeBit(bits >> i); } }
+void BitStream::writeBit(int bit) { writeBits(DWord(bit & 1), 1); }
+
+// store pending bits closing last byte with 0 bits
+void BitStream::flush() {
+	while (acc_bits > 0) {
+		if (byte_pos < cap) buf[byte_pos] = Byte(acc);
+		else overrun = true;
+		byte_pos++;
+		acc     >>= 8;
+		acc_bits -= 8;
+	}
+	acc      = 0;
+	acc_bits = 0;
 }
 
 // reading
-int BitStream::readBit() {
-	int ret = (buf[byte_pos] >> bit_pos++) & 1;
-	if (bit_pos > 7) { bit_pos = 0; byte_pos++; }
-	return ret;
-}
+int BitStream::readBit() { return readBits(1); }
 int BitStream::readBits(int count) {
-	int bits = 0;
-	if (count == 8 && bit_pos == 0) { bits = buf[byte_pos++]; }
-	else { for (int i = 0; i < count; i++) { bits |= readBit() << i; } }
-	return bits;
+	DWord bits;
+	if (acc_bits < count) refill();
+	bits = peekBits(count);
+	consume(count);
+	return int(bits);
 }
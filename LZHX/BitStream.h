@@ -7,32 +7,89 @@
 #ifndef LZHX_BITSTREAM_H
 #define LZHX_BITSTREAM_H
 
+// c++
+#include <cstring>
+
+// LZHX
 #include "Types.h"
 
 namespace LZHX {
 
-// easy bit reading/writing used in huffman compression
+// bit reading/writing from the lowest bit of every byte through 64 bit
+// accumulator; writer keeps pending bits in it and stores whole words,
+// reader loads 8 bytes at once, so at least 56 bits can be peeked after
+// refill; neither of them touches memory past capacity given with buffer,
+// writer marks overrun there and reader sees zero bits
 class BitStream {
 private:
-    Byte *buf;
-	int bit_pos, byte_pos;
+	Byte *buf;
+	int   cap, byte_pos, acc_bits;
+	QWord acc;
+	bool  reading, overrun;
+	void  refillEnd();
 public:
 	BitStream();
-	void assignBuffer(Byte *buf);
-    // pos
+	void assignBuffer(Byte *buf, int cap);
+    // pos, logical bit position of writer or reader
 	int  getBitPos();
 	int  getBytePos();
-	void setBitPos(int bit_pos);
 	void setBytePos(int byte_pos);
 	void resetPos();
+	bool isOverrun();
     // write
 	void writeBit(int bit);
-	void writeBits(int bits, int count);
+	void writeBits(DWord bits, int count);
+	void flush();
     // read
-	int readBit();
-	int readBits(int count);
+	int   readBit();
+	int   readBits(int count);
+	void  refill();
+	DWord peekBits(int count);
+	void  consume(int count);
 };
 
+// hot paths are inlined, count is at most 32 bits; whole word is written
+// little endian, as bytes go from the lowest one
+inline void BitStream::writeBits(DWord bits, int count) {
+	acc      |= (QWord(bits) & ((QWord(1) << count) - 1)) << acc_bits;
+	acc_bits += count;
+	if (acc_bits >= 32) {
+		if (byte_pos + 4 <= cap) memcpy(buf + byte_pos, &acc, sizeof(DWord));
+		else overrun = true;
+		byte_pos += 4;
+		acc     >>= 32;
+		acc_bits -= 32;
+	}
+}
+
+// bits above acc_bits are already next bits of stream, so reloading them
+// from new position doesn't change them and no branch on count is needed;
+// last 8 bytes are loaded one by one with zeros past capacity; everything
+// is inlined, so local copy of stream never leaves registers
+inline void BitStream::refillEnd() {
+	while (acc_bits < 56) {
+		if (byte_pos < cap) acc |= QWord(buf[byte_pos]) << acc_bits;
+		byte_pos++;
+		acc_bits += 8;
+	}
+}
+inline void BitStream::refill() {
+	QWord w;
+	reading = true;
+	if (byte_pos + 8 > cap) { refillEnd(); return; }
+	memcpy(&w, buf + byte_pos, sizeof(w));
+	acc      |= w << acc_bits;
+	byte_pos += (63 - acc_bits) >> 3;
+	acc_bits |= 56;
+}
+inline DWord BitStream::peekBits(int count) {
+	return DWord(acc & ((QWord(1) << count) - 1));
+}
+inline void BitStream::consume(int count) {
+	acc     >>= count;
+	acc_bits -= count;
+}
+
 } // namespace
 
 #endif // LZHX_BITSTREAM_H
@@ -0,0 +1,218 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+// c++
+#include <cstring>
+#include <cmath>
+
+// LZHX
+#include "CM.h"
+#include "Utils.h"
+
+using namespace LZHX;
+
+// constructors/destructors, probability moves by 1/(n+1.5) of its error
+// after n-th bit seen in its context, so new contexts learn fast
+CM::CM() {
+    int pi(0);
+    size[0] = CMNODES;
+    size[1] = 256 * CMNODES;
+    size[2] = (1 << CMO2BITS) * CMNODES;
+    for (int k = 0; k < CMORDERS; k++) {
+        prob[k] = new Word[size[k]];
+        cnt [k] = new Byte[size[k]];
+    }
+    weight = new int[CMNODES * CMORDERS];
+    for (int n = 0; n <= CMLIMIT; n++) rate[n] = int(65536 / (n + 1.5));
+
+    // squash is 12 bit probability of x / 256 in logistic domain and
+    // stretch its inverse, so both map between [0, 4096) and [-2048, 2048)
+    for (int i = 0; i < 4096; i++) {
+        int v = int(4096 / (1 + exp(-(i - 2048) / 256.0)));
+        squash[i] = v < 1 ? 1 : v > 4095 ? 4095 : v;
+    }
+    for (int i = 0; i < 4096; i++) {
+        for (int j = pi; j <= squash[i]; j++) stretch[j] = i - 2048;
+        pi = squash[i] + 1;
+    }
+    for (int j = pi; j < 4096; j++) stretch[j] = 2047;
+}
+CM::~CM() {
+    for (int k = 0; k < CMORDERS; k++) {
+        delete[] prob[k];
+        delete[] cnt [k];
+    }
+    delete[] weight;
+}
+
+// info
+CodecType CM::getCodecType() { return CT_CM; }
+int CM::getTotalIn()         { return total_in;  }
+int CM::getTotalOut()        { return total_out; }
+
+// init
+void CM::initStream(CodecStream *cs) {
+    this->codec_stream = cs;
+    this->total_in     = this->total_out = 0;
+}
+
+// every block starts with even probabilities, so it can be decoded alone
+void CM::reset() {
+    for (int k = 0; k < CMORDERS; k++) {
+        for (int i = 0; i < size[k]; i++) prob[k][i] = 1 << 15;
+        memset(cnt[k], 0, size[k]);
+    }
+    for (int i = 0; i < CMNODES * CMORDERS; i++) weight[i] = 22000;
+    x1 = 0;
+    x2 = 0xFFFFFFFF;
+    x  = 0;
+}
+
+// contexts of next byte - none, previous byte and hash of two of them
+void CM::setContext(int c1, int c2) {
+    idx[0] = 0;
+    idx[1] = c1 * CMNODES;
+    idx[2] = int((DWord((c2 << 8) | c1) * 0x9E3779B1) >> (32 - CMO2BITS)) * CMNODES;
+    node   = 1;
+}
+
+// mix predictions of all orders in logistic domain, probability of 1 is
+// kept away from 0 and 1, so coded bit never gets empty range
+int CM::predict() {
+    int dot(0), p, *w = weight + node * CMORDERS;
+    for (int k = 0; k < CMORDERS; k++) {
+        st[k] = stretch[prob[k][idx[k] + node] >> 4];
+        dot  += w[k] * st[k];
+    }
+    dot >>= 16;
+    if (dot < -2047) dot = -2047;
+    if (dot >  2047) dot =  2047;
+    p_mix = squash[dot + 2048];
+    p = p_mix << 4;
+    if (p < CMPMIN)         p = CMPMIN;
+    if (p > 65535 - CMPMIN) p = 65535 - CMPMIN;
+    return p;
+}
+
+// weights move along error gradient, every order adapts its probability
+void CM::update(int bit) {
+    int err = (bit << 12) - p_mix, *w = weight + node * CMORDERS;
+    for (int k = 0; k < CMORDERS; k++) {
+        int i = idx[k] + node, p = prob[k][i];
+        w[k] += (st[k] * err) >> 10;
+        p += ((bit << 16) - bit - p) * rate[cnt[k][i]] >> 16;
+        prob[k][i] = Word(p);
+        if (cnt[k][i] < CMLIMIT) cnt[k][i]++;
+    }
+    node = (node << 1) | bit;
+}
+
+// range is split by probability of 1, leading bytes which can't change
+// anymore are shifted out
+void CM::encodeBit(int bit) {
+    DWord xmid = x1 + DWord((QWord(x2 - x1) * predict()) >> 16);
+    if (bit) x2 = xmid;
+    else     x1 = xmid + 1;
+    update(bit);
+    while (((x1 ^ x2) & 0xFF000000) == 0) {
+        io[io_pos++] = Byte(x2 >> 24);
+        x1 <<= 8;
+        x2 = (x2 << 8) | 0xFF;
+    }
+}
+int CM::decodeBit() {
+    int bit;
+    DWord xmid = x1 + DWord((QWord(x2 - x1) * predict()) >> 16);
+    if (x <= xmid) { bit = 1; x2 = xmid; }
+    else           { bit = 0; x1 = xmid + 1; }
+    update(bit);
+    while (((x1 ^ x2) & 0xFF000000) == 0) {
+        x1 <<= 8;
+        x2 = (x2 << 8) | 0xFF;
+        x  = (x  << 8) | io[io_pos++];
+    }
+    return bit;
+}
+
+// compress block
+int CM::compressBlock() {
+    int in_size, c1(0), c2(0);
+    CodecBuffer *cb_in, *cb_out;
+    Byte *in;
+
+    // find one LZ stream and empty buffer for its code
+    cb_in        = codec_stream->find(CBT_LZ);
+    cb_out       = codec_stream->find(CBT_EMPTY);
+    cb_out->type = CBT_CM;
+    in           = cb_in->mem;
+    io           = cb_out->mem;
+    cb_in->type  = CBT_EMPTY;
+    in_size      = cb_in->size;
+
+    // write input size, then bits of every byte from the highest one;
+    // code which doesn't fit is reported at its full size, so stream is
+    // stored instead
+    reset();
+    io_pos = write32To8Buf(io, in_size);
+    for (int j = 0; j < in_size; j++) {
+        if (io_pos > cb_out->cap - CMIOPAD) {
+            io_pos = cb_out->cap;
+            break;
+        }
+        setContext(c1, c2);
+        for (int b = 7; b >= 0; b--) encodeBit((in[j] >> b) & 1);
+        c2 = c1;
+        c1 = in[j];
+    }
+
+    // flush whole low end of range
+    for (int b = 0; b < 4 && io_pos < cb_out->cap; b++) {
+        io[io_pos++] = Byte(x1 >> 24);
+        x1 <<= 8;
+    }
+
+    // update info
+    total_in    += in_size;
+    total_out   += io_pos;
+    cb_out->size = io_pos;
+
+    return cb_out->size;
+}
+
+// decompress block
+int CM::decompressBlock() {
+    int dec_size, c1(0), c2(0);
+    CodecBuffer *cb_in, *cb_out;
+    Byte *out;
+
+    // find one CM buffer and one empty
+    cb_in        = codec_stream->find(CBT_CM);
+    cb_out       = codec_stream->find(CBT_EMPTY);
+    cb_out->type = CBT_LZ;
+    io           = cb_in ->mem;
+    out          = cb_out->mem;
+    cb_in->type  = CBT_EMPTY;
+
+    // read decompressed size and first 4 code bytes
+    reset();
+    dec_size = read32From8Buf(io);
+    io_pos   = sizeof(DWord);
+    for (int b = 0; b < 4; b++) x = (x << 8) | io[io_pos++];
+
+    for (int j = 0; j < dec_size; j++) {
+        setContext(c1, c2);
+        while (node < CMNODES) decodeBit();
+        c2 = c1;
+        c1 = out[j] = Byte(node);
+    }
+
+    // update info
+    total_in    += cb_in->size;
+    total_out   += dec_size;
+    cb_out->size = dec_size;
+
+    return dec_size;
+}
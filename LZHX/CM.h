@@ -0,0 +1,60 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+#ifndef LZHX_CM_H
+#define LZHX_CM_H
+
+// LZHX
+#include "Types.h"
+
+// model
+#define CMNODES 256 // bit tree nodes of one byte, 0 is unused
+#define CMO2BITS 12 // hash bits of order-2 context
+#define CMORDERS 3  // orders 0, 1 and 2 are mixed
+#define CMLIMIT 30  // adaptation count limit, higher one adapts slower
+#define CMPMIN  32  // lowest probability out of 65536
+#define CMIOPAD 32  // code room kept for one byte and flush, at most 11 bits per bit
+
+namespace LZHX {
+
+// context model with binary arithmetic coder, every byte is coded as 8
+// bits and each bit has adaptive probabilities in contexts of 0, 1 and 2
+// previous bytes of the stream, mixed by weights learned per bit tree
+// node; in instruction stream previous byte is also previous literal or
+// match instruction, so it tells match state too
+class CM : public CodecInterface {
+private:
+    int total_in, total_out;
+    CodecStream *codec_stream;
+    Word        *prob[CMORDERS];
+    Byte        *cnt [CMORDERS];
+    int          size[CMORDERS], idx[CMORDERS], st[CMORDERS];
+    int         *weight;
+    int          rate[CMLIMIT + 1], stretch[4096], squash[4096];
+    // coder state
+    DWord x1, x2, x;
+    Byte *io;
+    int   io_pos, node, p_mix;
+    void reset();
+    void setContext(int c1, int c2);
+    int  predict();
+    void update(int bit);
+    void encodeBit(int bit);
+    int  decodeBit();
+public:
+    CM();
+    ~CM();
+    CodecType getCodecType();
+    int  getTotalIn();
+    int  getTotalOut();
+    void initStream(CodecStream *codec_stream);
+    int  compressBlock();
+    int  decompressBlock();
+};
+
+} // namespace
+
+#endif // LZHX_CM_H
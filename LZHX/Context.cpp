@@ -0,0 +1,271 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+// c++
+#include <cstring>
+#include <cmath>
+
+// LZHX
+#include "Context.h"
+#include "Globals.h"
+#include "Utils.h"
+#include "Huffman.h"
+#include "ANS.h"
+#include "CM.h"
+#include "ROLZ.h"
+
+using namespace LZHX;
+
+// create working buffers and codecs for settings, in chunked stream match
+// can't reach out of its chunk, so window is never bigger than chunk
+CodecContext::CodecContext(CodecSettings *s) {
+    sttgs = *s;
+    if (sttgs.bit_chnk_cap && sttgs.bit_mtch_pos > sttgs.bit_chnk_cap) {
+        sttgs.bit_mtch_pos  = sttgs.bit_chnk_cap;
+        sttgs.byte_mtch_pos = sttgs.byte_chnk_cap;
+        sttgs.mask_mtch_pos = sttgs.byte_chnk_cap - 1;
+    }
+    bffr_cnt  = sttgs.byte_bffr_cnt;
+    cdc_bffrs = new CodecBuffer[bffr_cnt];
+    for (int i = 0; i < bffr_cnt; i++) {
+        cdc_bffrs[i].cap  = outBlkSize(sttgs.byte_blk_cap);
+        cdc_bffrs[i].mem  = new Byte[cdc_bffrs[i].cap];
+        cdc_bffrs[i].type = CBT_EMPTY;
+        cdc_bffrs[i].size = 0;
+        cdc_bffrs[i].src  = nullptr;
+    }
+    cdc_strm.buf_count   = bffr_cnt;
+    cdc_strm.buf_stack   = cdc_bffrs;
+    cdc_strm.stream_size = 0;
+    if (sttgs.lz_codec == CT_ROLZ) lz_cdc = new ROLZ(&sttgs);
+    else                           lz_cdc = new LZ(&sttgs);
+    hf_cdc = new Huffman(256, sttgs.hf_streams);
+    an_cdc = new ANS;
+    cm_cdc = new CM;
+
+    // LZ streams coded with huffman or ANS are decoded while LZ goes,
+    // every one of them needs its own decoder
+    for (int i = 0; i < ILZSN; i++) {
+        hf_pull[i] = an_pull[i] = nullptr;
+        if (sttgs.lz_codec != CT_ROLZ) {
+            hf_pull[i] = new Huffman;
+            an_pull[i] = new ANS;
+        }
+    }
+
+    // block type and its streams with their sizes and coders
+    blk_bf.cap  = sizeof(Byte) + ILZSN * (outBlkSize(sttgs.byte_blk_cap) + sizeof(int) + sizeof(Byte));
+    blk_bf.mem  = new Byte[blk_bf.cap];
+    blk_bf.size = 0;
+    blk_bf.type = CBT_EMPTY;
+    blk_bf.src  = nullptr;
+    init();
+}
+
+// free working buffers and codecs
+CodecContext::~CodecContext() {
+    for (int i = 0; i < bffr_cnt; i++) delete[] cdc_bffrs[i].mem;
+    delete[] cdc_bffrs;
+    delete lz_cdc;
+    delete hf_cdc;
+    delete an_cdc;
+    delete cm_cdc;
+    for (int i = 0; i < ILZSN; i++) {
+        if (hf_pull[i]) delete hf_pull[i];
+        if (an_pull[i]) delete an_pull[i];
+    }
+    delete[] blk_bf.mem;
+}
+
+// start coding new file, LZ history is kept
+void CodecContext::init() {
+    for (int i = 0; i < bffr_cnt; i++) {
+        cdc_bffrs[i].size = 0;
+        cdc_bffrs[i].type = CBT_EMPTY;
+    }
+    lz_cdc->initStream(&cdc_strm);
+    hf_cdc->initStream(&cdc_strm);
+    an_cdc->initStream(&cdc_strm);
+    cm_cdc->initStream(&cdc_strm);
+}
+
+// start new chunk, it doesn't see anything coded before it; LZ drops its
+// history in place, so chunks don't pay for new tables
+void CodecContext::restart() {
+    lz_cdc->reset();
+    init();
+}
+
+// biggest raw block and biggest coded one
+int CodecContext::blockCap() { return sttgs.byte_blk_cap; }
+int CodecContext::codedCap() { return blk_bf.cap; }
+
+// quick look at raw block - share of positions which repeat 4 bytes
+// seen shortly before and order-0 entropy, decides if block goes
+// through LZ, entropy coding only or is stored
+BlockType CodecContext::probeBlock(Byte *buf, int size) {
+    int freq[256], last[4096], hits(0);
+    double bits(0);
+    DWord v;
+    if (size < prb_min) return BT_LZ;
+    memset(last, 0xFF, sizeof(last));
+    for (int i = 0; i + 4 <= size; i++) {
+        memcpy(&v, buf + i, sizeof(v));
+        int h = int((v * 0x9E3779B1) >> 20);
+        if (last[h] >= 0 && memcmp(buf + last[h], buf + i, sizeof(v)) == 0) hits++;
+        last[h] = i;
+    }
+    if (hits * prb_rep > size) return BT_LZ;
+    countBytes(buf, size, freq);
+    for (int s = 0; s < 256; s++)
+        if (freq[s]) bits -= freq[s] * log2(double(freq[s]) / size);
+    return bits * 100 >= double(size) * prb_bits ? BT_RAW : BT_ENT;
+}
+
+// append coded stream with its size and coder to block buffer, stream
+// buffer is freed
+void CodecContext::stageStream(CodecBuffer *bf) {
+    Byte t = Byte(bf->type);
+    memcpy(blk_bf.mem + blk_bf.size, &bf->size, sizeof(int));
+    blk_bf.mem[blk_bf.size + sizeof(int)] = t;
+    memcpy(blk_bf.mem + blk_bf.size + sizeof(int) + sizeof(Byte), bf->mem, bf->size);
+    blk_bf.size += sizeof(int) + sizeof(Byte) + bf->size;
+    bf->type = CBT_EMPTY;
+}
+
+// code LZ stream with entropy coders enabled in settings, huffman if
+// none is; the smallest output is kept and others freed, stream is
+// stored when none of them makes it smaller
+CodecBuffer *CodecContext::entropyCode(CodecBuffer *lz_bf) {
+    static const CodecBufferType out_t[3] = { CBT_HF, CBT_ANS, CBT_CM };
+    CodecInterface *cdc[3] = { hf_cdc, an_cdc, cm_cdc };
+    CodecBuffer *best(nullptr), *bf;
+    DWord use = sttgs.ent_codec ? sttgs.ent_codec : DWord(CT_HF);
+    for (int k = 0; k < 3; k++) {
+        if (!(use & cdc[k]->getCodecType())) continue;
+        lz_bf->type = CBT_LZ;
+        cdc[k]->compressBlock();
+        bf = cdc_strm.find(out_t[k]);
+        if (best && best->size <= bf->size) {
+            bf->type = CBT_EMPTY;
+            continue;
+        }
+        if (best) best->type = CBT_EMPTY;
+        best = bf;
+    }
+    if (best->size >= lz_bf->size) {
+        memcpy(best->mem, lz_bf->mem, lz_bf->size);
+        best->size = lz_bf->size;
+        best->type = CBT_STORE;
+    }
+    return best;
+}
+
+// read coded stream and decode it with coder it was written with,
+// stored stream is used as it is; k-th stream of LZ block coded with
+// huffman or ANS is left to its pull decoder, if there is one
+const Byte *CodecContext::readStream(const Byte *src, int k) {
+    Byte t;
+    CodecBuffer *bf = cdc_strm.find(CBT_EMPTY);
+    memcpy(&bf->size, src, sizeof(int));
+    t = src[sizeof(int)];
+    memcpy(bf->mem, src + sizeof(int) + sizeof(Byte), bf->size);
+    bf->src = nullptr;
+    switch (t) {
+        case CBT_STORE: bf->type = CBT_LZ;  break;
+        case CBT_ANS:
+            bf->type = CBT_ANS;
+            if (k >= 0 && (bf->src = an_pull[k])) bf->type = CBT_PULL;
+            else an_cdc->decompressBlock();
+            break;
+        case CBT_CM:    bf->type = CBT_CM;  cm_cdc->decompressBlock(); break;
+        default:
+            bf->type = CBT_HF;
+            if (k >= 0 && (bf->src = hf_pull[k])) bf->type = CBT_PULL;
+            else hf_cdc->decompressBlock();
+            break;
+    }
+    return src + sizeof(int) + sizeof(Byte) + bf->size;
+}
+
+// code one raw block, it's compressed with LZ and its streams with
+// huffman, ANS or context model, block without repeats is only entropy
+// coded as one stream and block which doesn't get smaller is stored;
+// coded block is valid until next call
+CodecBuffer *CodecContext::compressBlock(const Byte *in, int size) {
+    BlockType blk_t;
+    CodecBuffer *raw_bf, *lz_bf;
+
+    // copy block into empty buffer, LZ keeps it until block is coded
+    raw_bf = cdc_strm.find(CBT_EMPTY);
+    memcpy(raw_bf->mem, in, size);
+    raw_bf->size = size;
+    raw_bf->type = CBT_RAW;
+    blk_bf.size  = sizeof(Byte);
+    blk_t = probeBlock(raw_bf->mem, raw_bf->size);
+
+    if (blk_t == BT_LZ) {
+        lz_cdc->compressBlock();
+        raw_bf->type = CBT_RAW;
+        lz_bf = cdc_strm.find(CBT_LZ);
+        while (lz_bf) {
+            stageStream(entropyCode(lz_bf));
+            lz_bf = cdc_strm.find(CBT_LZ);
+        }
+    } else if (blk_t == BT_ENT) {
+        raw_bf->type = CBT_LZ;
+        stageStream(entropyCode(raw_bf));
+        raw_bf->type = CBT_RAW;
+        lz_cdc->passBlock(raw_bf->mem, raw_bf->size);
+    } else {
+        lz_cdc->passBlock(raw_bf->mem, raw_bf->size);
+    }
+
+    // store block if coding didn't make it smaller
+    if (blk_t != BT_RAW && blk_bf.size - int(sizeof(Byte)) >= raw_bf->size + int(sizeof(int)))
+        blk_t = BT_RAW;
+    if (blk_t == BT_RAW) {
+        memcpy(blk_bf.mem + sizeof(Byte), &raw_bf->size, sizeof(int));
+        memcpy(blk_bf.mem + sizeof(Byte) + sizeof(int), raw_bf->mem, raw_bf->size);
+        blk_bf.size = sizeof(Byte) + sizeof(int) + raw_bf->size;
+    }
+    blk_bf.mem[0] = Byte(blk_t);
+    raw_bf->type  = CBT_EMPTY;
+    return &blk_bf;
+}
+
+// decode one coded block from src, used gets its coded size; returned
+// raw buffer has to be freed by caller before next call
+CodecBuffer *CodecContext::decompressBlock(const Byte *src, int *used) {
+    const Byte *p = src + sizeof(Byte);
+    CodecBuffer *raw_bf;
+
+    // stored block goes to LZ history as it is
+    if (src[0] == BT_RAW) {
+        raw_bf = cdc_strm.find(CBT_EMPTY);
+        memcpy(&raw_bf->size, p, sizeof(int));
+        memcpy(raw_bf->mem, p + sizeof(int), raw_bf->size);
+        p += sizeof(int) + raw_bf->size;
+        raw_bf->type = CBT_RAW;
+        lz_cdc->passBlock(raw_bf->mem, raw_bf->size);
+
+    // entropy coded block is one stream of raw data
+    } else if (src[0] == BT_ENT) {
+        p = readStream(p);
+        raw_bf = cdc_strm.find(CBT_LZ);
+        raw_bf->type = CBT_RAW;
+        lz_cdc->passBlock(raw_bf->mem, raw_bf->size);
+
+    // read LZ streams and decompress LZ from them into one block,
+    // it pulls symbols of coded ones itself
+    } else {
+        for (int i = 0; i < ILZSN; i++) p = readStream(p, i);
+        lz_cdc->decompressBlock();
+        raw_bf = cdc_strm.find(CBT_RAW);
+    }
+    *used = int(p - src);
+    return raw_bf;
+}
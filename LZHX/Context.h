@@ -0,0 +1,47 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+#ifndef LZHX_CONTEXT_H
+#define LZHX_CONTEXT_H
+
+// LZHX
+#include "Types.h"
+#include "LZ.h"
+
+namespace LZHX {
+
+// everything one thread needs to code blocks - working buffers, LZ with
+// its history and entropy coders; coded block is block type followed by
+// its streams or by size and data of stored block
+class CodecContext {
+private:
+    CodecSettings   sttgs;
+    int             bffr_cnt;
+    CodecBuffer    *cdc_bffrs, blk_bf;
+    CodecStream     cdc_strm;
+    CodecInterface *lz_cdc, *hf_cdc, *an_cdc, *cm_cdc;
+    CodecInterface *hf_pull[ILZSN], *an_pull[ILZSN];
+
+    // function for counting working buffer size
+    int outBlkSize(int inBlkSize) { return inBlkSize * 2; }
+    BlockType    probeBlock(Byte *buf, int size);
+    void         stageStream(CodecBuffer *bf);
+    CodecBuffer *entropyCode(CodecBuffer *lz_bf);
+    const Byte  *readStream(const Byte *src, int k = -1);
+public:
+    CodecContext(CodecSettings *sttgs);
+    ~CodecContext();
+    void restart();
+    void init();
+    int  blockCap();
+    int  codedCap();
+    CodecBuffer *compressBlock(const Byte *in, int size);
+    CodecBuffer *decompressBlock(const Byte *src, int *used);
+};
+
+} // namespace
+
+#endif // LZHX_CONTEXT_H
@@ -20,19 +20,35 @@ char const S_INF2 [] =    " Info       : File archiver based on Lempel-Ziv and H
                           " Website    : http://ziach.pl/\n"
                           " Date       : 2018\n"
                           " Version    : 1.0\n";
-char const S_USAGE1[] =   " Usage: LZHX.exe <file/folder/archive to compress/decompress> [l]\n";
+char const S_USAGE1[] =   " Usage: LZHX.exe <file/folder/archive to compress/decompress> [l|1-9][r][x][m|p] [threads]\n";
 char const S_USAGE2[] =   "  The program will automatically recognize whether the given parameter\n"
                           "  is an archive  for  decompression or a file/folder  for  compression.\n"
                           "  It  will also prevent overwriting files by creating unique names for\n"
                           "  outputed files and folders if needed.\n\n"
                           "  l - if the first parameter is an archive and you use this option, the\n"
                           "      archive will not be unpacked but only a text file with a file list\n"
-                          "      will be created.\n";
+                          "      will be created.\n"
+                          "  1-9 - compression level, 1 is the fastest, 9 gives the best ratio,\n"
+                          "      level 3 is used by default. Archive remembers its level.\n"
+                          "  r - use reduced offset LZ, it can follow compression level, e.g. 5r.\n"
+                          "      Usually better for text at levels 1-7, levels 8-9 do better\n"
+                          "      without it.\n"
+                          "  x - high ratio mode, streams may be coded with order 0-2 context\n"
+                          "      model, much slower in both directions, e.g. 9x.\n"
+                          "  m - multithreaded mode, files are split into 1-4 MB chunks coded\n"
+                          "      independently by as many threads as there are cores or as\n"
+                          "      given after options, e.g. 5m 8. Archive is the same for any\n"
+                          "      number of threads, ratio is a bit worse than without it.\n"
+                          "  p - parallel match search, archive stays one solid stream and\n"
+                          "      matches of each block are searched by many threads before\n"
+                          "      it's coded, e.g. 6p 8. It's for plain LZ levels 1-6 only,\n"
+                          "      levels 7-9 search binary trees with one thread anyway.\n";
 char const S_ERR_FOPN[] = " File error.\n";
 char const S_ERR_EX  [] = " Exception: ";
 char const S_ERR_UNEX[] = " Unknown exception.\n";
 char const S_ERR_HASH[] = " Error - different file hashes.\n";
 char const S_ERR_WPAS[] = " Wrong password.\n";
+char const S_ERR_VER [] = " Archive was created by another version of LZHX.\n";
 char const S_PASS1 []   = " Type password if you want to encrypt this archive or just press enter:";
 char const S_PASS2 []   = " Archive is encrypted. Type password:";
 char const S_COMP  []   = " Compress   : ";
@@ -48,11 +64,33 @@ char const S_LZEXT[]    = "lzhx";
 char const S_EMPTY[]    = "";
 char const S_LISTC1     = 'l';
 char const S_LISTC2     = 'L';
+char const S_ROLZC1     = 'r';
+char const S_ROLZC2     = 'R';
+char const S_CMC1       = 'x';
+char const S_CMC2       = 'X';
+char const S_MTC1       = 'm';
+char const S_MTC2       = 'M';
+char const S_PSC1       = 'p';
+char const S_PSC2       = 'P';
 
 // archive signature
 Byte  const sig[4] = { 'L','Z','H','X' };
 DWord const sig2   = 0xFFFFFFFB;
 
+// block probe - LZ is skipped when fewer than 1 of prb_rep positions
+// repeats 4 bytes seen before, then block is stored if its order-0 entropy
+// is at least prb_bits / 100 bits per byte; smaller blocks aren't probed
+int const prb_min  = 4096;
+int const prb_rep  = 128;
+int const prb_bits = 790;
+
+// blocks in flight between reader, coder and writer thread, in each
+// direction
+int const io_bufs  = 4;
+
+// archive format version
+DWord const ver    = 14;
+
 // archive extension
 
 
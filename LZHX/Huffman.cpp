@@ -4,7 +4,13 @@
 // date  : 2018                        //
 /////////////////////////////////////////
 
+// c++
+#include <cstring>
+#include <algorithm>
+
+// LZHX
 #include "Huffman.h"
+#include "Utils.h"
 
 using namespace LZHX;
 
@@ -23,9 +29,6 @@ bool HuffmanTree::isLeaf() {
 void HuffmanCode::clear()  { code = 0; bit_count = 0; }
 HuffmanCode::HuffmanCode() { clear(); }
 
-// huffman symbol pair
-HuffmanSymbolPair::HuffmanSymbolPair() { first = second = nullptr; }
-
 // huffman main class
 void Huffman::reset() {
 	for (int i = 0; i < alphabet_size * 2; i++) {
@@ -39,103 +42,306 @@ void Huffman::reset() {
 
 // create histogram
 void Huffman::countFrequencies(Byte *buf, int in_size) {
-	for (int i = 0; i < in_size; i++) nodes[buf[i]].freq++;
-}
-
-// sorting histogram
-void Huffman::findLowestFreqSymbolPair(HuffmanSymbolPair &sp) {
-	sp.first = sp.second = nullptr;
-	int i = 0;
-	while (i < nodes_array_size) {
-		HuffmanTree *currentNode = nodes + i;
-		if (currentNode->freq > 0) {
-			if (sp.first == nullptr)       { sp.first  = currentNode; }
-			else if (sp.second == nullptr) { sp.second = currentNode; }
-			else if (sp.first->freq  > currentNode->freq) { sp.first  = currentNode; }
-			else if (sp.second->freq > currentNode->freq) { sp.second = currentNode; }
+	int freq[256];
+	countBytes(buf, in_size, freq);
+	for (int s = 0; s < alphabet_size; s++) nodes[s].freq = freq[s];
+}
+
+// leaves order - by frequency, then by symbol
+static bool lessFreq(const HuffmanTree *a, const HuffmanTree *b) {
+	return a->freq < b->freq || (a->freq == b->freq && a->symbol < b->symbol);
+}
+
+// tree building with two queues - sorted leaves and parents, parents are
+// made with growing frequencies so the two lowest nodes are always at the
+// heads of queues
+void Huffman::buildTree() {
+	int leaf_cnt(0), l(0);
+	HuffmanTree *p = parents, *pair[2];
+	for (int s = 0; s < alphabet_size; s++)
+		if (nodes[s].freq > 0) leaves[leaf_cnt++] = nodes + s;
+	std::sort(leaves, leaves + leaf_cnt, lessFreq);
+	if (leaf_cnt == 1) root = leaves[0];
+	for (int n = 1; n < leaf_cnt; n++) {
+		for (int k = 0; k < 2; k++) {
+			if (l < leaf_cnt && (p == parents || leaves[l]->freq <= p->freq))
+				pair[k] = leaves[l++];
+			else
+				pair[k] = p++;
 		}
-		i++;
+		parents->freq  = pair[0]->freq + pair[1]->freq;
+		parents->right = pair[0];
+		parents->left  = pair[1];
+		root = parents++;
 	}
 }
 
-// tree building
-void Huffman::buildTree() {
-	while (true) {
-		HuffmanSymbolPair sp;
-		findLowestFreqSymbolPair(sp);
-		if (sp.second == nullptr) {
-			root = sp.first;
-			break;
-		} else {
-			parents->freq   = sp.first->freq + sp.second->freq;
-			parents->right  = sp.first;
-			parents->left   = sp.second;
-			sp.first ->freq = 0;
-			sp.second->freq = 0;
-			parents++;
+// code lengths are depths of leaves in tree
+void Huffman::makeLengths(HuffmanTree *node, int bit_count) {
+	if (node->isLeaf()) codes[node->symbol].bit_count = bit_count;
+	if (node->right != nullptr) makeLengths(node->right, bit_count + 1);
+	if (node->left  != nullptr) makeLengths(node->left,  bit_count + 1);
+}
+
+// cut codes longer than HFMAXBITS - they are counted as HFMAXBITS long and
+// while kraft sum is too big, one longest code is dropped and one shorter
+// is split into two codes a bit longer; new lengths go to symbols in order
+// of their old ones, so more frequent symbols still get shorter codes
+void Huffman::limitLengths() {
+	int num[HFMAXBITS + 1], total(0), k, max_len(0);
+	memset(num, 0, sizeof(num));
+	for (int s = 0; s < alphabet_size; s++) {
+		if (codes[s].bit_count > max_len) max_len = codes[s].bit_count;
+		if (codes[s].bit_count > 0)
+			num[codes[s].bit_count < HFMAXBITS ? codes[s].bit_count : HFMAXBITS]++;
+	}
+	if (max_len <= HFMAXBITS) return;
+	for (int i = 1; i <= HFMAXBITS; i++) total += num[i] << (HFMAXBITS - i);
+	while (total > (1 << HFMAXBITS)) {
+		num[HFMAXBITS]--;
+		for (int i = HFMAXBITS - 1; i > 0; i--) {
+			if (num[i]) {
+				num[i]--;
+				num[i + 1] += 2;
+				break;
+			}
+		}
+		total--;
+	}
+	k = 1;
+	for (int l = 1; l <= max_len; l++) {
+		for (int s = 0; s < alphabet_size; s++) {
+			if (codes[s].bit_count != l) continue;
+			while (num[k] == 0) k++;
+			num[k]--;
+			codes[s].bit_count = -k;
 		}
 	}
+	for (int s = 0; s < alphabet_size; s++) codes[s].bit_count = -codes[s].bit_count;
 }
 
-// make huffan codes
-void Huffman::makeCodes(HuffmanTree *node, int code, int bit_count) {
-	if (node->isLeaf()) {
-		codes[node->symbol].code = code;
-		codes[node->symbol].bit_count = bit_count;
+// canonical codes - codes of one length are consecutive numbers in symbol
+// order, bits are reversed because stream is written from the lowest bit
+void Huffman::makeCanonical() {
+	int num[HFMAXBITS + 1], next[HFMAXBITS + 1], code(0);
+	memset(num, 0, sizeof(num));
+	for (int s = 0; s < alphabet_size; s++) num[codes[s].bit_count]++;
+	num[0] = 0;
+	for (int l = 1; l <= HFMAXBITS; l++) {
+		code    = (code + num[l - 1]) << 1;
+		next[l] = code;
+	}
+	for (int s = 0; s < alphabet_size; s++) {
+		int l = codes[s].bit_count, c, r(0);
+		if (l == 0) continue;
+		c = next[l]++;
+		for (int b = 0; b < l; b++) r |= ((c >> b) & 1) << (l - 1 - b);
+		codes[s].code = r;
 	}
-	if (node->right != nullptr)
-		makeCodes(node->right, code | (1 << bit_count), bit_count + 1);
-	if (node->left != nullptr)
-		makeCodes(node->left, code, bit_count + 1);
 }
 
-// writing tree to stream
-void Huffman::writeTree(HuffmanTree *node) {
-	if (node->isLeaf()) {
+// code lengths written in symbol order as 4 bit length followed by how
+// many times it repeats - 2 bits for 1 to 3 times or 3 and 8 more bits for
+// 4 to 259 times; when fewer symbols are used it's cheaper to list them
+// with their lengths; block of one symbol only stores that symbol and its
+// codes take no bits
+static inline int lengthRun(HuffmanCode *codes, int s, int alphabet_size) {
+	int run = 1;
+	while (s + run < alphabet_size && run < 259 && codes[s + run].bit_count == codes[s].bit_count) run++;
+	return run;
+}
+void Huffman::writeLengths() {
+	int used(0), run_bits(0), run;
+	if (root == nullptr || root->isLeaf()) {
 		bit_stream->writeBit(1);
-		bit_stream->writeBits(node->symbol, 8);
-	} else { bit_stream->writeBit(0); }
-	if (node->right != nullptr) { writeTree(node->right); }
-	if (node->left  != nullptr) { writeTree(node->left);  }
+		bit_stream->writeBits(root ? root->symbol : 0, 8);
+		return;
+	}
+	bit_stream->writeBit(0);
+	for (int s = 0; s < alphabet_size; s += run) {
+		run       = lengthRun(codes, s, alphabet_size);
+		run_bits += run <= 3 ? 6 : 14;
+		if (codes[s].bit_count) used += run;
+	}
+	if (8 + used * 12 < run_bits) {
+		bit_stream->writeBit(1);
+		bit_stream->writeBits(used - 1, 8);
+		for (int s = 0; s < alphabet_size; s++) {
+			if (codes[s].bit_count == 0) continue;
+			bit_stream->writeBits(s, 8);
+			bit_stream->writeBits(codes[s].bit_count, 4);
+		}
+		return;
+	}
+	bit_stream->writeBit(0);
+	for (int s = 0; s < alphabet_size; s += run) {
+		run = lengthRun(codes, s, alphabet_size);
+		bit_stream->writeBits(codes[s].bit_count, 4);
+		if (run <= 3) {
+			bit_stream->writeBits(run - 1, 2);
+		} else {
+			bit_stream->writeBits(3, 2);
+			bit_stream->writeBits(run - 4, 8);
+		}
+	}
+}
+void Huffman::readLengths() {
+	if (bit_stream->readBit()) {
+		int s = bit_stream->readBits(8);
+		for (int f = 0; f < HFLUTSIZE; f++) {
+			lut[f].sym  = Word(s);
+			lut[f].bits = 0;
+			lut[f].cnt  = 1;
+		}
+		return;
+	}
+	if (bit_stream->readBit()) {
+		int used = bit_stream->readBits(8) + 1;
+		while (used--) {
+			int s = bit_stream->readBits(8);
+			codes[s].bit_count = bit_stream->readBits(4);
+		}
+	} else {
+		for (int s = 0; s < alphabet_size; ) {
+			int l = bit_stream->readBits(4), run = bit_stream->readBits(2) + 1;
+			if (run == 4) run += bit_stream->readBits(8);
+			for (; run > 0 && s < alphabet_size; run--) codes[s++].bit_count = l;
+		}
+	}
+	makeCanonical();
+	buildLookup();
+}
+
+// decoding tables - every HFLUTBITS bit value points at symbol its code
+// starts with, codes are written from the lowest bit so longer values
+// just repeat entries; prefixes of longer codes link to second level
+// tables sized for the longest code below them
+void Huffman::buildLookup() {
+	int size = 0;
+	memset(lut_sub_bits, 0, sizeof(int) * HFLUTSIZE);
+	for (int f = 0; f < HFLUTSIZE; f++) {
+		lut[f].sym  = 0;
+		lut[f].bits = 0;
+		lut[f].cnt  = 1;
+	}
+	for (int s = 0; s < alphabet_size; s++) {
+		int pfx = codes[s].code & HFLUTMASK, rest = codes[s].bit_count - HFLUTBITS;
+		if (rest > lut_sub_bits[pfx]) lut_sub_bits[pfx] = rest;
+	}
+	for (int p = 0; p < HFLUTSIZE; p++) {
+		if (lut_sub_bits[p] == 0) continue;
+		lut[p].sym  = Word(size);
+		lut[p].bits = Byte(lut_sub_bits[p]);
+		lut[p].cnt  = 0;
+		size += 1 << lut_sub_bits[p];
+	}
+	if (size > lut_sub_cap) {
+		delete[] lut_sub;
+		lut_sub     = new HuffmanLookup[size];
+		lut_sub_cap = size;
+	}
+	for (int s = 0; s < alphabet_size; s++) {
+		int c = codes[s].code, l = codes[s].bit_count, rest = l - HFLUTBITS;
+		if (l == 0) continue;
+		if (rest <= 0) {
+			for (int f = c; f < HFLUTSIZE; f += 1 << l) {
+				lut[f].sym  = Word(s);
+				lut[f].bits = Byte(l);
+				lut[f].cnt  = 1;
+			}
+		} else if (lut[c & HFLUTMASK].cnt == 0) {
+			HuffmanLookup *sub = lut_sub + lut[c & HFLUTMASK].sym;
+			for (int f = c >> HFLUTBITS; f < (1 << lut[c & HFLUTMASK].bits); f += 1 << rest) {
+				sub[f].sym  = Word(s);
+				sub[f].bits = Byte(l);
+				sub[f].cnt  = 1;
+			}
+		}
+	}
 }
 
-// reading tree from stream
-HuffmanTree *Huffman::readTree(HuffmanTree *node) {
-	int bit = bit_stream->readBit();
-	if (bit == 1) {
-		node->symbol = bit_stream->readBits(8);
-		node->right  = node->left  = nullptr;
-		node->freq   = 0;
-		return node;
-	} else if (bit == 0) {
-		node->right = node + 1;
-		node->left  = readTree(node->right) + 1;
-		return readTree(node->left);
+// pair table - second code is looked up in bits left after the first one
+void Huffman::buildPairs() {
+	for (int x = 0; x < HFLUTSIZE; x++) {
+		HuffmanLookup *e = lut + x, *n;
+		lut_pair[x] = *e;
+		if (e->cnt != 1 || e->bits >= HFLUTBITS) continue;
+		n = lut + (x >> e->bits);
+		if (n->cnt != 1 || e->bits + n->bits > HFLUTBITS) continue;
+		lut_pair[x].sym  = Word(e->sym | (n->sym << 8));
+		lut_pair[x].bits = e->bits + n->bits;
+		lut_pair[x].cnt  = 2;
+	}
+}
+
+// decode symbols of one stream into out between o and end, two short
+// codes at once while there is room for both; one refill is enough for
+// HFPAIRS lookups of at most 15 bits; streams are passed as local copies,
+// so their accumulators stay in registers
+static inline void decodePair(const HuffmanLookup *lut_pair, const HuffmanLookup *lut_sub,
+	BitStream &bs, Byte *out, int &o) {
+	const HuffmanLookup *e = lut_pair + bs.peekBits(HFLUTBITS);
+	if (e->cnt == 0) {
+		e = lut_sub + e->sym + (bs.peekBits(HFLUTBITS + e->bits) >> HFLUTBITS);
+		out[o++] = Byte(e->sym);
+		bs.consume(e->bits);
+		return;
+	}
+	out[o]     = Byte(e->sym);
+	out[o + 1] = Byte(e->sym >> 8);
+	o += e->cnt;
+	bs.consume(e->bits);
+}
+static inline BitStream decodeTail(const HuffmanLookup *lut, const HuffmanLookup *lut_pair,
+	const HuffmanLookup *lut_sub, BitStream bs, Byte *out, int o, int end) {
+	const HuffmanLookup *e;
+	while (o + 1 < end) {
+		bs.refill();
+		decodePair(lut_pair, lut_sub, bs, out, o);
+	}
+	while (o < end) {
+		bs.refill();
+		e = lut + bs.peekBits(HFLUTBITS);
+		if (e->cnt == 0)
+			e = lut_sub + e->sym + (bs.peekBits(HFLUTBITS + e->bits) >> HFLUTBITS);
+		out[o++] = Byte(e->sym);
+		bs.consume(e->bits);
 	}
-	return nullptr;
+	return bs;
 }
 
-// reading symbol from stream using huffman tree
-int Huffman::decodeSymbol(HuffmanTree *node) {
-	if (node->isLeaf()) { return node->symbol; }
-	int bit = bit_stream->readBit();
-	if      (bit == 1) { return decodeSymbol(node->right); }
-	else if (bit == 0) { return decodeSymbol(node->left);  }
-	else                 return 0;
+// write codes of n bytes
+void Huffman::writeCodes(Byte *in, int n) {
+	for (int i = 0; i < n; i++) {
+		HuffmanCode *currentCode = codes + in[i];
+		bit_stream->writeBits(currentCode->code, currentCode->bit_count);
+	}
 }
 
 // constructors/destructors
-Huffman::Huffman(int alphabet_size) {
+Huffman::Huffman(int alphabet_size, int streams) {
 	this->alphabet_size = alphabet_size;
+	this->streams = streams > 1 ? HFSTREAMS : 1;
 	nodes_array_size = alphabet_size * 2;
 	nodes = new HuffmanTree[nodes_array_size];
 	codes = new HuffmanCode[alphabet_size];
+	leaves = new HuffmanTree*[alphabet_size];
 	bit_stream = new BitStream;
+	lut          = new HuffmanLookup[HFLUTSIZE];
+	lut_pair     = new HuffmanLookup[HFLUTSIZE];
+	lut_sub_bits = new int[HFLUTSIZE];
+	lut_sub      = nullptr;
+	lut_sub_cap  = 0;
 }
 Huffman::~Huffman() {
 	delete[] nodes;
 	delete[] codes;
+	delete[] leaves;
 	delete bit_stream;
+	delete[] lut;
+	delete[] lut_pair;
+	delete[] lut_sub;
+	delete[] lut_sub_bits;
 }
 
 // info
@@ -151,7 +357,8 @@ void Huffman::initStream(CodecStream *cs) {
 
 // compress block
 int Huffman::compressBlock() {
-    int in_size;
+    int in_size, jmp, beg;
+    bool split;
     CodecBuffer *cb_in, *cb_out;
     Byte *in, *out;
 
@@ -165,25 +372,43 @@ int Huffman::compressBlock() {
 	in_size      = cb_in->size;
 
 	reset();
-    
-    // write input size to stream
-	bit_stream->assignBuffer(out);
-	bit_stream->writeBits(in_size, 32);
+	split = streams > 1 && in_size >= HFMULTIMIN;
 
-    // build and write tree
+    // write input size to stream, with flag when block is split
+	bit_stream->assignBuffer(out, cb_out->cap);
+	bit_stream->writeBits(in_size | (split ? HFMULTI : 0), 32);
+
+    // build tree and write lengths of its codes
 	countFrequencies(in, in_size);
 	buildTree();
-	makeCodes(root, 0, 0);
-	writeTree(root);
+	if (root) makeLengths(root, 0);
+	limitLengths();
+	writeLengths();
+	makeCanonical();
 
-    // for each byte write assigned code to output
-	for (int i = 0; i < in_size; i++) {
-		HuffmanCode *currentCode = codes + in[i];
-		bit_stream->writeBits(currentCode->code, currentCode->bit_count);
+    // for each byte write assigned code to output; streams of split
+    // block get every HFSTREAMS-th segment, they are byte aligned and jump
+    // table with sizes of all but the last one goes before them
+	if (split) {
+		bit_stream->flush();
+		jmp = bit_stream->getBytePos();
+		bit_stream->setBytePos(jmp + (HFSTREAMS - 1) * sizeof(DWord));
+		for (int k = 0; k < HFSTREAMS; k++) {
+			beg = bit_stream->getBytePos();
+			for (int p = k * HFSEG; p < in_size; p += HFSTREAMS * HFSEG)
+				writeCodes(in + p, in_size - p < HFSEG ? in_size - p : HFSEG);
+			bit_stream->flush();
+			if (k < HFSTREAMS - 1)
+				write32To8Buf(out + jmp + k * sizeof(DWord), bit_stream->getBytePos() - beg);
+		}
+	} else {
+		writeCodes(in, in_size);
+		bit_stream->flush();
 	}
 
-    // close last byte with 0 bits
-	while (bit_stream->getBitPos() > 0) bit_stream->writeBit(0);
+    // code which doesn't fit is reported at its full size, so stream is
+    // stored instead
+	if (bit_stream->isOverrun()) bit_stream->setBytePos(cb_out->cap);
 
     // update info
 	total_in    += in_size;
@@ -193,35 +418,93 @@ int Huffman::compressBlock() {
 	return cb_out->size;
 }
 
-// decompress block
+// decompress block, whole of it is pulled at once
 int Huffman::decompressBlock() {
-    int dec_size;
+    int o(0), n;
     CodecBuffer *cb_in, *cb_out;
-    Byte *in, *out;
 
     // find one huffman buffer and one empty
 	cb_in        = codec_stream->find(CBT_HF);
 	cb_out       = codec_stream->find(CBT_EMPTY); 
     cb_out->type = CBT_LZ;
-    in           = cb_in ->mem;
-	out          = cb_out->mem;
 	cb_in->type  = CBT_EMPTY;
 
-	reset();
+	openBlock(cb_in);
+	while ((n = pullSymbols(cb_out->mem + o)) > 0) o += n;
+	cb_out->size = o;
 
-    // read decompressed size and tree
-	bit_stream->assignBuffer(in);
-    dec_size = bit_stream->readBits(32);
-	readTree(nodes);
+	return o;
+}
 
-    // decode each symbol
-	for (int o = 0; o < dec_size; o++)
-        out[o] = Byte(decodeSymbol(nodes));
+// open block for decoding - read decompressed size and code lengths
+// and find streams of split block
+int Huffman::openBlock(CodecBuffer *cb_in) {
+    int pos, jmp;
+    DWord head;
+    Byte *in = cb_in->mem;
+
+	reset();
+	bit_stream->assignBuffer(in, cb_in->size);
+    head      = DWord(bit_stream->readBits(32));
+    dec_size  = int(head & ~HFMULTI);
+    dec_pos   = 0;
+    dec_split = (head & HFMULTI) != 0;
+	readLengths();
+	buildPairs();
+
+	if (dec_split) {
+		// locate streams with jump table, damaged one can't point past input
+		jmp = bit_stream->getBytePos() + (bit_stream->getBitPos() > 0);
+		pos = jmp + (HFSTREAMS - 1) * sizeof(DWord);
+		for (int k = 0; k < HFSTREAMS; k++) {
+			if (pos > cb_in->size) pos = cb_in->size;
+			lane[k].assignBuffer(in + pos, cb_in->size - pos);
+			if (k < HFSTREAMS - 1) pos += read32From8Buf(in + jmp + k * sizeof(DWord));
+		}
+	} else {
+		lane[0] = *bit_stream;
+	}
 
     // update info
-	total_in    += cb_in->size;
-	total_out   += dec_size;
-	cb_out->size = dec_size;
+	total_in  += cb_in->size;
+	total_out += dec_size;
 
 	return dec_size;
 }
+
+// decode next round of symbols, segment of each stream in split block
+int Huffman::pullSymbols(Byte *out) {
+    int n, o[HFSTREAMS], end[HFSTREAMS];
+
+	n = dec_size - dec_pos < CDCROUND ? dec_size - dec_pos : CDCROUND;
+	if (n <= 0) return 0;
+	dec_pos += n;
+	if (!dec_split) {
+		lane[0] = decodeTail(lut, lut_pair, lut_sub, lane[0], out, 0, n);
+		return n;
+	}
+	for (int k = 0; k < HFSTREAMS; k++) {
+		o  [k] = k * HFSEG < n ? k * HFSEG : n;
+		end[k] = (k + 1) * HFSEG < n ? (k + 1) * HFSEG : n;
+	}
+
+	// decode all segments in one loop, their codes don't depend on each
+	// other so they are looked up in parallel
+	BitStream s0 = lane[0], s1 = lane[1], s2 = lane[2], s3 = lane[3];
+	while (o[0] + 2 * HFPAIRS <= end[0] && o[1] + 2 * HFPAIRS <= end[1] &&
+		   o[2] + 2 * HFPAIRS <= end[2] && o[3] + 2 * HFPAIRS <= end[3]) {
+		s0.refill(); s1.refill(); s2.refill(); s3.refill();
+		for (int i = 0; i < HFPAIRS; i++) {
+			decodePair(lut_pair, lut_sub, s0, out, o[0]);
+			decodePair(lut_pair, lut_sub, s1, out, o[1]);
+			decodePair(lut_pair, lut_sub, s2, out, o[2]);
+			decodePair(lut_pair, lut_sub, s3, out, o[3]);
+		}
+	}
+	lane[0] = decodeTail(lut, lut_pair, lut_sub, s0, out, o[0], end[0]);
+	lane[1] = decodeTail(lut, lut_pair, lut_sub, s1, out, o[1], end[1]);
+	lane[2] = decodeTail(lut, lut_pair, lut_sub, s2, out, o[2], end[2]);
+	lane[3] = decodeTail(lut, lut_pair, lut_sub, s3, out, o[3], end[3]);
+
+	return n;
+}
@@ -11,6 +11,23 @@
 #include "Types.h"
 #include "BitStream.h"
 
+// longest code, lengths are stored on 4 bits
+#define HFMAXBITS 15
+
+// bits peeked for one decoding table lookup
+#define HFLUTBITS 11
+#define HFLUTSIZE (1 << HFLUTBITS)
+#define HFLUTMASK (HFLUTSIZE - 1)
+
+// big blocks are split into segments of HFSEG symbols which take turns
+// in HFSTREAMS separate streams, so decoder follows them together and
+// every round of them is one pull; flag is kept in top bit of block size
+#define HFSTREAMS  4
+#define HFSEG      (CDCROUND / HFSTREAMS)
+#define HFMULTI    0x80000000
+#define HFMULTIMIN 4096 // smaller blocks stay in one stream
+#define HFPAIRS    3    // pair lookups per refill of 56 bits
+
 namespace LZHX {
 
 // huffman tree node
@@ -31,32 +48,43 @@ public:
 	HuffmanCode();
 };
 
-// symbol pair for building tree
-class HuffmanSymbolPair {
+// decoding table entry - one or two symbols with their total code length
+// or, for codes longer than HFLUTBITS, link to second level table
+class HuffmanLookup {
 public:
-	HuffmanTree *first, *second;
-	HuffmanSymbolPair();
+	Word  sym;  // symbols, first in low byte, or second level table offset
+	Byte  bits; // length of code(s) or index bits of second level table
+	Byte  cnt;  // symbols decoded, 0 for link
 };
 
 // huffman compression algorithm
 class Huffman : public CodecInterface {
 private:
 	int alphabet_size,nodes_array_size,
-        total_in, total_out,stream_size;
+        total_in, total_out,stream_size, streams;
 	CodecStream  *codec_stream;
-	HuffmanTree  *nodes, *parents, *root;
+	HuffmanTree  *nodes, *parents, *root, **leaves;
 	HuffmanCode  *codes;
 	BitStream    *bit_stream;
+	HuffmanLookup *lut, *lut_pair, *lut_sub;
+	int           *lut_sub_bits, lut_sub_cap;
+	// decoding state between pulls
+	BitStream      lane[HFSTREAMS];
+	int            dec_size, dec_pos;
+	bool           dec_split;
 	void reset();
 	void countFrequencies(Byte *buf, int in_size);
-	void findLowestFreqSymbolPair(HuffmanSymbolPair &sp);
 	void buildTree();
-	void makeCodes(HuffmanTree *node, int code, int bit_count);
-	void writeTree(HuffmanTree *node);
-	HuffmanTree *readTree(HuffmanTree *node);
-	int decodeSymbol(HuffmanTree *node);
+	void makeLengths(HuffmanTree *node, int bit_count);
+	void limitLengths();
+	void makeCanonical();
+	void writeLengths();
+	void readLengths();
+	void buildLookup();
+	void buildPairs();
+	void writeCodes(Byte *in, int n);
 public:
-	Huffman(int alphabet_size = 256);
+	Huffman(int alphabet_size = 256, int streams = HFSTREAMS);
 	~Huffman();
 	CodecType getCodecType();
 	int getTotalIn();
@@ -64,6 +92,8 @@ public:
 	void initStream(CodecStream *codec_stream);
 	int compressBlock();
 	int decompressBlock();
+	int openBlock(CodecBuffer *cb_in);
+	int pullSymbols(Byte *out);
 };
 
 } // namespace
@@ -7,41 +7,268 @@
 #include <iostream>
 #include <memory>
 #include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+
+// x86 intrinsics
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LZHX_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LZHX_AVX2
+#else
+#define LZHX_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 // LHZX
 #include "LZ.h"
 #include "Utils.h"
+#include "Threads.h"
 
 using namespace LZHX;
 
+// index of lowest set bit
+static inline int ctz32(DWord v) {
+#ifdef _MSC_VER
+    unsigned long i; _BitScanForward(&i, v); return int(i);
+#else
+    return __builtin_ctz(v);
+#endif
+}
+static inline int ctz64(QWord v) {
+    if (DWord(v)) return ctz32(DWord(v));
+    return 32 + ctz32(DWord(v >> 32));
+}
+
+// index of highest set bit
+static inline int bsr32(DWord v) {
+#ifdef _MSC_VER
+    unsigned long i; _BitScanReverse(&i, v); return int(i);
+#else
+    return 31 - __builtin_clz(v);
+#endif
+}
+
+// tail shared by all kernels - 8 byte words, then single bytes
+static inline int matchLengthTail(const Byte *a, const Byte *b, int i, int lim) {
+    QWord wa, wb;
+    while (i + 8 <= lim) {
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        if (wa != wb) return i + (ctz64(wa ^ wb) >> 3);
+        i += 8;
+    }
+    while (i < lim && a[i] == b[i]) i++;
+    return i;
+}
+#ifndef LZHX_X86
+static int matchLengthScalar(const Byte *a, const Byte *b, int lim) {
+    return matchLengthTail(a, b, 0, lim);
+}
+#else
+static int matchLengthSSE2(const Byte *a, const Byte *b, int lim) {
+    int i(0), msk;
+    while (i + 16 <= lim) {
+        msk = _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i*)(a + i)),
+            _mm_loadu_si128((const __m128i*)(b + i))));
+        if (msk != 0xFFFF) return i + ctz32(DWord(~msk));
+        i += 16;
+    }
+    return matchLengthTail(a, b, i, lim);
+}
+LZHX_AVX2 static int matchLengthAVX2(const Byte *a, const Byte *b, int lim) {
+    int i(0);
+    DWord msk;
+    while (i + 32 <= lim) {
+        msk = DWord(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i*)(a + i)),
+            _mm256_loadu_si256((const __m256i*)(b + i)))));
+        if (msk != 0xFFFFFFFF) return i + ctz32(~msk);
+        i += 32;
+    }
+    return matchLengthTail(a, b, i, lim);
+}
+#endif
+
+// pick best kernel once, when program starts, so threads only read it
+static int (*matchLengthPick())(const Byte*, const Byte*, int) {
+#ifdef LZHX_X86
+#ifdef _MSC_VER
+    int r[4];
+    bool avx2 = false;
+    __cpuid(r, 0);
+    if (r[0] >= 7) {
+        __cpuid(r, 1);
+        bool os_avx = (r[2] & (1 << 27)) && (r[2] & (1 << 28)) &&
+            ((_xgetbv(0) & 6) == 6);
+        __cpuidex(r, 7, 0);
+        avx2 = os_avx && (r[1] & (1 << 5));
+    }
+    return avx2 ? matchLengthAVX2 : matchLengthSSE2;
+#else
+    return __builtin_cpu_supports("avx2") ? matchLengthAVX2 : matchLengthSSE2;
+#endif
+#else
+    return matchLengthScalar;
+#endif
+}
+static int (*const matchLengthImpl)(const Byte*, const Byte*, int) = matchLengthPick();
+int LZHX::matchLength(const Byte *a, const Byte *b, int lim) {
+    return lim > 0 ? matchLengthImpl(a, b, lim) : 0;
+}
+
 // dictionary buffer
 LZDictionaryBuffer::~LZDictionaryBuffer() { if (arr) delete[] arr; }
-LZDictionaryBuffer::LZDictionaryBuffer(int cap) {
-    this->cap = cap;
-    arr = new Byte[cap];
+LZDictionaryBuffer::LZDictionaryBuffer(int cap, int mirr) {
+    this->cap  = cap;
+    this->mirr = mirr < cap ? mirr : cap;
+    arr = new Byte[cap + this->mirr];
     pos = size = 0;
-    for (int i = 0; i < cap; i++) arr[i] = 0;
+    for (int i = 0; i < cap + this->mirr; i++) arr[i] = 0;
 }
 // insert byte into ring buffer
 Byte *LZDictionaryBuffer::putByte(Byte val) {
     if (pos >= cap) pos = 0;
     if (size < cap) size++;
+    if (pos < mirr) arr[cap + pos] = val;
     arr[pos] = val;
     return &arr[pos++];
 }
-// convert position absolute to relative and conversely
-int LZDictionaryBuffer::convPos(bool abs_to_rel, int p) {
-    if (abs_to_rel) {
-        if (this->pos >= p) return  this->pos - p;
-        else                return (this->cap - p) + this->pos;
-    } else {
-        if (this->pos >= p) return this->pos -  p;
-        else                return this->cap - (p - this->pos);
+// insert whole block into ring buffer, only last cap bytes are kept and
+// ring position moves past the skipped ones, so it stays stream position
+// modulo cap
+void LZDictionaryBuffer::putBlock(const Byte *src, int n) {
+    int k;
+    if (n > cap) {
+        pos  = (pos + n - cap) % cap;
+        src += n - cap;
+        n    = cap;
+    }
+    if (pos >= cap) pos = 0;
+    size = size + n < cap ? size + n : cap;
+
+    // part up to the end of ring and the rest from its start
+    k = cap - pos < n ? cap - pos : n;
+    memcpy(arr + pos, src, k);
+    if (pos < mirr) memcpy(arr + cap + pos, src, (mirr - pos < k ? mirr - pos : k));
+    pos += k;
+    if (n > k) {
+        memcpy(arr, src + k, n - k);
+        memcpy(arr + cap, src + k, (mirr < n - k ? mirr : n - k));
+        pos = n - k;
+    }
+}
+// copy n bytes starting back bytes before current position
+void LZDictionaryBuffer::copyTo(Byte *dst, int back, int n) {
+    int p = pos - back, k;
+    if (p < 0) p += cap;
+    k = cap - p < n ? cap - p : n;
+    memcpy(dst, arr + p, k);
+    memcpy(dst + k, arr, n - k);
+}
+// copy match to output at o exactly, part of it reaching before current
+// block comes from dictionary, the rest from output where it may overlap
+// itself
+void LZDictionaryBuffer::copyMatch(Byte *out, int o, int dist, int len) {
+    Byte *dst = out + o, *src;
+    int   hist = dist - o, n;
+    if (hist > 0) {
+        n = len < hist ? len : hist;
+        copyTo(dst, hist, n);
+        dst += n;
+        len -= n;
+    }
+    if (len <= 0) return;
+    src = dst - dist;
+
+    // run of one byte or repeating pattern, copied part doubles each step
+    if (dist == 1) {
+        memset(dst, *src, len);
+        return;
+    }
+    while (len > 0) {
+        n = int(dst - src) < len ? int(dst - src) : len;
+        memcpy(dst, src, n);
+        dst += n;
+        len -= n;
     }
 }
+// start ring again from its beginning, old bytes are never read
+void LZDictionaryBuffer::rewind() { pos = size = 0; }
 Byte LZDictionaryBuffer::getByte(int p) { return arr[p]; }
 int  LZDictionaryBuffer::getPos()       { return pos; }
 
+// buckets, pairs above direct ones split each bit width in two halves;
+// table entries past 32 bit values are empty
+LZBuckets::LZBuckets(int direct) {
+    this->direct = direct;
+    for (int b = 0; b < ILZBKTN; b++) {
+        int n = direct + 1 + ((b - (1 << direct)) >> 1);
+        if (b < (1 << direct)) {
+            base[b] = DWord(b);
+            bits[b] = 0;
+        } else if (n <= 32) {
+            base[b] = (DWord(1) << (n - 1)) | (DWord(b & 1) << (n - 2));
+            bits[b] = Byte(n - 2);
+        } else {
+            base[b] = 0;
+            bits[b] = 0;
+        }
+    }
+}
+int LZBuckets::bucket(DWord v) {
+    int n;
+    if (v < (DWord(1) << direct)) return int(v);
+    n = bsr32(v);
+    return (1 << direct) + 2 * (n - direct) + int((v >> (n - 1)) & 1);
+}
+
+// stream window, room for two rounds is enough to top up less than one
+LZWindow::LZWindow() {
+    mem = new Byte[2 * CDCROUND];
+    open(nullptr);
+}
+LZWindow::~LZWindow() { delete[] mem; }
+void LZWindow::open(CodecBuffer *cb) {
+    src  = nullptr;
+    cur  = end = mem;
+    size = 0;
+    if (cb == nullptr) return;
+    if (cb->type == CBT_PULL) {
+        src  = cb->src;
+        size = src->openBlock(cb);
+        return;
+    }
+    cur  = cb->mem;
+    end  = cb->mem + cb->size;
+    size = cb->size;
+}
+
+// make sure n symbols, at most CDCROUND, are ready; rest of window moves
+// to its start and rounds are pulled after it, damaged stream which ends
+// early gives zeros
+void LZWindow::fill(int n) {
+    int k, m;
+    if (src == nullptr || end - cur >= n) return;
+    k = int(end - cur);
+    memmove(mem, cur, k);
+    cur = mem;
+    end = mem + k;
+    while (end - cur < n) {
+        if ((m = src->pullSymbols(end)) <= 0) {
+            memset(end, 0, n - k);
+            end = cur + n;
+            break;
+        }
+        end += m;
+        k   += m;
+    }
+}
+
 // lz match
 LZMatch::LZMatch()    { clear(); }
 void LZMatch::clear() {pos = len = 0; }
@@ -50,112 +277,310 @@ void LZMatch::copy(LZMatch *lzm) {
     len = lzm->len;
 }
 
-// lz dictionary node - item of lookup table - first item of linked list
-LZDictionaryNode::LZDictionaryNode() {
-    next = prev = nullptr; clear();
-}
-void LZDictionaryNode::clear() {
-    if (next != nullptr) next->prev = nullptr;
-    if (prev != nullptr) prev->next = nullptr;
-    next = prev = nullptr;
-    valid = false;
-    pos = 0;
-}
-
 // match finder
 LZMatchFinder::LZMatchFinder(CodecSettings *cdc_sttgs) {
+    DWord hsh_bytes  = cdc_sttgs->byte_lkp_hsh < 8 ? cdc_sttgs->byte_lkp_hsh : 8;
     this->lz_buf     = nullptr;
     this->buf        = nullptr;
     this->buf_size   = 0;
-    this->lkp_tab    = new LZDictionaryNode[cdc_sttgs->byte_lkp_cap ];  
-    this->dict_tab   = new LZDictionaryNode[cdc_sttgs->byte_mtch_pos];
-    this->best_match = new LZMatch; 
+    this->mtch_cnt   = 0;
+    this->blk_base   = 0;
+    this->blk_floor  = 0;
+    this->matches    = new LZMatch[cdc_sttgs->byte_runs + 1];
     this->cdc_sttgs  = cdc_sttgs;
-    this->dict_i = 0;
-    for (int i = 0; i < (int)cdc_sttgs->byte_lkp_cap;  i++) lkp_tab  [i].clear();
-    for (int i = 0; i < (int)cdc_sttgs->byte_mtch_pos; i++) dict_tab[i].clear();
+    this->hsh_shift  = 64 - cdc_sttgs->bit_lkp_cap;
+    this->hsh_mask   = hsh_bytes < 8 ? (QWord(1) << (hsh_bytes * 8)) - 1 : ~QWord(0);
 }
 LZMatchFinder::~LZMatchFinder() {
-    delete[] this->lkp_tab;
-    delete[] this->dict_tab;
-    delete this->best_match;
+    delete[] this->matches;
 }
 void LZMatchFinder::assignBuffer(Byte *b, int bs, LZDictionaryBuffer *lzb) {
-    this->buf      = b;
-    this->buf_size = bs;
-    this->lz_buf   = lzb;
+    // previous block is already in dictionary so move absolute position
+    this->blk_base += this->buf_size;
+    this->buf       = b;
+    this->buf_size  = bs;
+    this->lz_buf    = lzb;
+}
+
+// start new stream in place, positions go on after the last block and
+// floor hides older ones, so tables are cleared only when positions get
+// near DWord range; true when they were rebased to 0 then and dictionary
+// must be rewound with them
+bool LZMatchFinder::reset() {
+    blk_base += buf_size;
+    buf_size  = 0;
+    blk_floor = blk_base;
+    if (blk_base < ILZREBASE) return false;
+    blk_base = blk_floor = 0;
+    clear();
+    return true;
+}
+
+// multiplicative hash of first byte_lkp_hsh bytes taken from one word load
+int LZMatchFinder::hash(Byte *in, int avail) {
+    QWord val = 0;
+    if (avail >= 8) memcpy(&val, in, 8);
+    else            memcpy(&val, in, avail);
+    return int(((val & hsh_mask) * 0x9E3779B97F4A7C15ULL) >> hsh_shift);
 }
 
-// FNV hash
-int LZMatchFinder::hash(Byte *in) {
-    DWord hash = 0x811C9DC5;
-    for (int i = 0; i < int(cdc_sttgs->byte_lkp_hsh); i++) {
-        hash ^= in[i];
-        hash *= 0x1000193;
+// longest match allowed at pos, 0 if there are too few bytes to hash
+int LZMatchFinder::maxLen(int pos) {
+    int max_len = buf_size - pos;
+    if (max_len <= int(cdc_sttgs->byte_lkp_hsh)) return 0;
+    if (max_len > int(cdc_sttgs->mask_mtch_len)) max_len = cdc_sttgs->mask_mtch_len;
+    return max_len;
+}
+
+// common prefix of stream dist bytes back and stream at pos, candidate
+// starting in dictionary runs on into current block and may overlap pos
+int LZMatchFinder::streamLen(int dist, int pos, int len, int max_len) {
+    int   hist = dist - pos, lim;
+    Byte *cur  = buf + pos, *dct;
+    if (hist > 0) {
+        lim = max_len < hist ? max_len : hist;
+        if (len < lim) {
+            dct  = lz_buf->arr + ((blk_base - hist) & cdc_sttgs->mask_mtch_pos);
+            len += matchLength(dct + len, cur + len, lim - len);
+            if (len < lim) return len;
+        }
     }
-    return hash & cdc_sttgs->mask_lkp_cap;
+    return len + matchLength(cur + len - dist, cur + len, max_len - len);
 }
 
-// insert new item into dictionary
-void LZMatchFinder::insert(int pos) {
-    if (buf_size - pos  <= int(cdc_sttgs->byte_lkp_hsh )) return;
-    if (dict_i >= int(cdc_sttgs->byte_mtch_pos))
-        dict_i = 0;
-    LZDictionaryNode *current = lkp_tab   + hash(buf + pos);
-    LZDictionaryNode *empty   = dict_tab + dict_i++;
-    empty->clear();
-    empty->pos     = current->pos;
-    empty->next    = current->next;
-    if (empty->next) empty->next->prev = empty;
-    empty->prev    = current;
-    empty->valid   = true;
-    current->pos   = lz_buf->getPos();
-    current->next  = empty;
-    current->prev  = nullptr;
-    current->valid = true;
-}
-
-// find item in dictionary
+// i-th byte of candidate dist bytes back from pos
+Byte LZMatchFinder::streamByte(int dist, int pos, int i) {
+    int hist = dist - pos;
+    if (i < hist) return lz_buf->arr[(blk_base - hist + i) & cdc_sttgs->mask_mtch_pos];
+    return buf[pos + i - dist];
+}
+
+// length of run repeating previous byte, it's match at distance 1
+int LZMatchFinder::runLen(int pos) { return repLen(1, pos); }
+
+// length of match at given distance, 0 if it reaches before stream start
+// or outside of window
+int LZMatchFinder::repLen(int dist, int pos) {
+    int max_len = maxLen(pos);
+    if (max_len == 0 || DWord(dist) > blk_base - blk_floor + pos || DWord(dist) > cdc_sttgs->mask_mtch_pos) return 0;
+    return streamLen(dist, pos, 0, max_len);
+}
+
+// best match or empty one
 LZMatch *LZMatchFinder::find(int pos) {
-    int runs, i;
-    LZDictionaryNode *current;
-    best_match->clear();
-    if (buf_size - pos <= (int)(cdc_sttgs->byte_lkp_hsh) || pos == 0) return best_match;
-    current = lkp_tab + hash(buf + pos);
-    runs    = 0;
-    while (current && (runs++ < int(cdc_sttgs->byte_runs))) {
-        if (current->valid) {
-            i = 0;
-            while (buf[pos + i] == lz_buf->getByte(current->pos + i)) {
-                if (pos + i >= buf_size - 1 || current->pos + i >= lz_buf->size - 1) break;
-                if (i >= int(cdc_sttgs->mask_mtch_len)) break;
-                i++;
-            }
-            if (best_match->len < i) {
-                best_match->pos = current->pos;
-                best_match->len = i;
+    mtch_cnt = findAll(pos);
+    if (mtch_cnt == 0) { match_empty.clear(); return &match_empty; }
+    return matches + mtch_cnt - 1;
+}
+LZMatch *LZMatchFinder::getMatches() { return matches; }
+
+// hash chain match finder
+LZHashChain::LZHashChain(CodecSettings *cdc_sttgs) : LZMatchFinder(cdc_sttgs) {
+    this->head = new DWord[cdc_sttgs->byte_lkp_cap];
+    this->prev = new DWord[cdc_sttgs->byte_mtch_pos];
+    clear();
+}
+LZHashChain::~LZHashChain() {
+    delete[] this->head;
+    delete[] this->prev;
+}
+void LZHashChain::clear() {
+    memset(head, 0, sizeof(DWord) * cdc_sttgs->byte_lkp_cap);
+    memset(prev, 0, sizeof(DWord) * cdc_sttgs->byte_mtch_pos);
+}
+
+// insert new item into dictionary
+void LZHashChain::insert(int pos) {
+    if (buf_size - pos <= int(cdc_sttgs->byte_lkp_hsh)) return;
+    DWord abs_pos = blk_base + pos;
+    int   h       = hash(buf + pos, buf_size - pos);
+    prev[abs_pos & cdc_sttgs->mask_mtch_pos] = head[h];
+    head[h] = abs_pos + 1;
+}
+
+// walk chain from cand and put matches into out, nothing is changed
+int LZHashChain::search(int pos, DWord cand, LZMatch *out) {
+    int   runs, max_len, best, len, cnt(0);
+    DWord abs_pos, dist, last_dist;
+    Byte *cur;
+    if ((max_len = maxLen(pos)) == 0) return 0;
+    abs_pos   = blk_base + pos;
+    cur       = buf + pos;
+    last_dist = 0;
+    best      = 0;
+    runs      = 0;
+    while (cand > blk_floor && (runs++ < int(cdc_sttgs->byte_runs))) {
+
+        // distances must grow along the chain, otherwise slot was overwritten
+        dist = abs_pos - (cand - 1);
+        if (dist <= last_dist || dist > cdc_sttgs->mask_mtch_pos) break;
+        last_dist = dist;
+        cand      = prev[(cand - 1) & cdc_sttgs->mask_mtch_pos];
+
+        // quick reject on byte which would make match better
+        if (best >= max_len || streamByte(dist, pos, best) != cur[best]) continue;
+
+        len = streamLen(dist, pos, 0, max_len);
+        if (best < len) {
+            best = out[cnt].len = len;
+            out[cnt++].pos = dist;
+            if (len >= max_len) break;
+        }
+    }
+    return cnt;
+}
+
+// find items in dictionary
+int LZHashChain::findAll(int pos) {
+    if (maxLen(pos) == 0) return 0;
+    return search(pos, head[hash(buf + pos, buf_size - pos)], matches);
+}
+
+// find items in dictionary before inserted pos, its link leads to the
+// same chain findAll would walk before it was inserted; only positions
+// about a block short of window size are lost, their slots are taken by
+// the rest of the block
+int LZHashChain::findInserted(int pos, LZMatch *out) {
+    if (maxLen(pos) == 0) return 0;
+    return search(pos, prev[(blk_base + pos) & cdc_sttgs->mask_mtch_pos], out);
+}
+
+// binary tree match finder
+LZBinaryTree::LZBinaryTree(CodecSettings *cdc_sttgs) : LZMatchFinder(cdc_sttgs) {
+    this->head     = new DWord[cdc_sttgs->byte_lkp_cap];
+    this->son      = new DWord[cdc_sttgs->byte_mtch_pos * 2];
+    clear();
+}
+LZBinaryTree::~LZBinaryTree() {
+    delete[] this->head;
+    delete[] this->son;
+}
+void LZBinaryTree::clear() {
+    last_abs = 0;
+    memset(head, 0, sizeof(DWord) * cdc_sttgs->byte_lkp_cap);
+    memset(son, 0, sizeof(DWord) * cdc_sttgs->byte_mtch_pos * 2);
+}
+
+// walk tree from root replacing it with current position, every visited
+// node is split to left (smaller suffixes) or right (greater) subtree,
+// suffixes are compared up to ILZTREEML bytes only
+int LZBinaryTree::update(int pos, bool collect) {
+    int   max_len, tree_len, len, len0(0), len1(0), best(0), view, win_pos, cnt(0);
+    int   depth = cdc_sttgs->byte_runs;
+    DWord abs_pos, cand, dist, *ptr0, *ptr1, *pair;
+    Byte  cand_byte;
+    if ((max_len = maxLen(pos)) == 0) return 0;
+    tree_len = max_len < ILZTREEML ? max_len : ILZTREEML;
+    abs_pos  = blk_base + pos;
+    last_abs = abs_pos + 1;
+    win_pos  = abs_pos & cdc_sttgs->mask_mtch_pos;
+    ptr1     = son + (win_pos << 1);
+    ptr0     = ptr1 + 1;
+
+    // current position becomes new root
+    int h   = hash(buf + pos, buf_size - pos);
+    cand    = head[h];
+    head[h] = abs_pos + 1;
+
+    while (true) {
+        dist = abs_pos - (cand - 1);
+        if (cand <= blk_floor || depth-- == 0 || dist > cdc_sttgs->mask_mtch_pos) {
+            *ptr0 = *ptr1 = 0;
+            break;
+        }
+        win_pos = (cand - 1) & cdc_sttgs->mask_mtch_pos;
+        pair    = son + (win_pos << 1);
+        len     = streamLen(dist, pos, len0 < len1 ? len0 : len1, tree_len);
+
+        // suffixes cut at tree_len or block end can leave tree slightly
+        // out of order, so length of match is counted from scratch
+        if (collect && best < max_len && streamByte(dist, pos, best) == buf[pos + best]) {
+            view = streamLen(dist, pos, 0, max_len);
+            if (best < view) {
+                best = matches[cnt].len = view;
+                matches[cnt++].pos = dist;
             }
         }
-        current = current->next;
+
+        // whole suffix matches, node is replaced by current position
+        if (len >= tree_len) {
+            *ptr1 = pair[0];
+            *ptr0 = pair[1];
+            break;
+        }
+        cand_byte = streamByte(dist, pos, len);
+        if (cand_byte < buf[pos + len]) {
+            *ptr1 = cand;
+            ptr1  = pair + 1;
+            cand  = *ptr1;
+            len1  = len;
+        } else {
+            *ptr0 = cand;
+            ptr0  = pair;
+            cand  = *ptr0;
+            len0  = len;
+        }
     }
-    return best_match;
+    return cnt;
+}
+
+// insert new item into dictionary, skip position already inserted by find
+void LZBinaryTree::insert(int pos) {
+    if (blk_base + pos + 1 == last_abs) return;
+    update(pos, false);
 }
 
+// find items in dictionary
+int LZBinaryTree::findAll(int pos) { return update(pos, true); }
+
 // lz algorith main class
-LZ::LZ(CodecSettings *cdc_sttgs) {
+LZ::LZ(CodecSettings *cdc_sttgs) : pos_bkt(ILZPOSDIR), len_bkt(ILZLENDIR) {
     bit_stream = new BitStream; 
-    lz_mf      = new LZMatchFinder(cdc_sttgs);
-    lz_buf     = new LZDictionaryBuffer(cdc_sttgs->byte_mtch_pos);
-    tmp_btebf  = new Byte[cdc_sttgs->byte_mtch_len];
-    lz_match   = nullptr;
-    rolz_match = nullptr;
+    lz_hc      = nullptr;
+    if (cdc_sttgs->mtch_fndr == MFT_BT) lz_mf = new LZBinaryTree(cdc_sttgs);
+    else                                lz_mf = lz_hc = new LZHashChain(cdc_sttgs);
+    lz_buf     = new LZDictionaryBuffer(cdc_sttgs->byte_mtch_pos, cdc_sttgs->byte_mtch_len);
     this->cdc_sttgs = cdc_sttgs;
+
+    // prices start at 8 bits per symbol and follow symbol statistics
+    for (int j = 0; j < ILZSN; j++) {
+        prc[j] = new int[256];
+        for (int k = 0; k < 256; k++) prc[j][k] = 8 * ILZPRCSCL;
+    }
+    opt_prc = opt_len = opt_dst = opt_rep = tkn_len = tkn_dst = nullptr;
+    if (cdc_sttgs->prs_strtgy == PS_OPTIMAL) {
+        opt_prc = new int[ILZOPTSEG + 1];
+        opt_len = new int[ILZOPTSEG + 1];
+        opt_dst = new int[ILZOPTSEG + 1];
+        opt_rep = new int[(ILZOPTSEG + 1) * ILZREPN];
+        tkn_len = new int[ILZOPTSEG];
+        tkn_dst = new int[ILZOPTSEG];
+    }
+
+    // hash chains can be searched by threads ahead of parser
+    mtch_pool = nullptr;
+    pre_off   = pre_cnt = nullptr;
+    if (cdc_sttgs->mtch_thrds && lz_hc) {
+        mtch_pool = new ThreadPool(int(cdc_sttgs->mtch_thrds));
+        pre_mtch.resize((cdc_sttgs->byte_blk_cap + ILZMTSEG - 1) / ILZMTSEG);
+        pre_off = new int[cdc_sttgs->byte_blk_cap];
+        pre_cnt = new int[cdc_sttgs->byte_blk_cap];
+    }
 }
 LZ::~LZ() {
     if (bit_stream) delete bit_stream;
     if (lz_mf)      delete lz_mf;
     if (lz_buf)     delete lz_buf;
-    if (tmp_btebf)  delete [] tmp_btebf;
+    for (int j = 0; j < ILZSN; j++) delete[] prc[j];
+    if (opt_prc)    delete [] opt_prc;
+    if (opt_len)    delete [] opt_len;
+    if (opt_dst)    delete [] opt_dst;
+    if (opt_rep)    delete [] opt_rep;
+    if (tkn_len)    delete [] tkn_len;
+    if (tkn_dst)    delete [] tkn_dst;
+    if (mtch_pool)  delete mtch_pool;
+    if (pre_off)    delete [] pre_off;
+    if (pre_cnt)    delete [] pre_cnt;
 }
 
 // info
@@ -170,85 +595,370 @@ void LZ::initStream(CodecStream *cs) {
     this->total_out    = 0;
 }
 
+// new stream in place, finder hides what it holds and prices start at 8
+// bits per symbol again, like in new LZ
+void LZ::reset() {
+    if (lz_mf->reset()) lz_buf->rewind();
+    for (int j = 0; j < ILZSN; j++)
+        for (int k = 0; k < 256; k++) prc[j][k] = 8 * ILZPRCSCL;
+}
+
+// search matches at positions of one segment of block, parser goes over
+// long match or run without searching inside it, so those positions are
+// skipped too; skipped position has count -1
+void LZ::searchSegment(int seg) {
+    std::vector<LZMatch> &v = pre_mtch[seg];
+    std::vector<LZMatch>  found(cdc_sttgs->byte_runs + 1);
+    int end  = (seg + 1) * ILZMTSEG < in_size ? (seg + 1) * ILZMTSEG : in_size;
+    int lng  = cdc_sttgs->prs_strtgy == PS_OPTIMAL ? ILZOPTLONG : ILZNICEML;
+    int skip = 0, len, cnt;
+    v.clear();
+    for (int i = seg * ILZMTSEG; i < end; i++) {
+        pre_off[i] = int(v.size());
+        pre_cnt[i] = -1;
+        if (i < skip) continue;
+        if ((len = lz_hc->runLen(i)) >= lng) {
+            skip = i + len;
+            continue;
+        }
+        cnt = pre_cnt[i] = lz_hc->findInserted(i, found.data());
+        v.insert(v.end(), found.begin(), found.begin() + cnt);
+        if (cnt > 0 && found[cnt - 1].len >= lng) skip = i + found[cnt - 1].len;
+    }
+}
+
+// insert whole block into hash chains, then search its segments with
+// threads; chains don't change while they're searched and every position
+// gets the same matches as if parser searched it, so archive is the same
+// for any number of threads; failed search is thrown again by wait()
+void LZ::searchBlock() {
+    for (int i = 0; i < in_size; i++) lz_hc->insert(i);
+    for (int s = 0; s * ILZMTSEG < in_size; s++)
+        mtch_pool->submit([this, s](int) { searchSegment(s); });
+    mtch_pool->wait();
+}
+
+// matches at i, from parallel search or searched now; position skipped
+// by parallel search gives the same matches when searched here
+int LZ::matchesAt(int i, LZMatch **mtchs) {
+    if (mtch_pool && pre_cnt[i] >= 0) {
+        *mtchs = pre_mtch[i / ILZMTSEG].data() + pre_off[i];
+        return pre_cnt[i];
+    }
+    *mtchs = lz_mf->getMatches();
+    if (mtch_pool) return lz_hc->findInserted(i, *mtchs);
+    return lz_mf->findAll(i);
+}
+
+// add i into match finder, block searched ahead is in it already
+void LZ::insert(int i) {
+    if (!mtch_pool) lz_mf->insert(i);
+}
+
+// add n bytes into match finder, dictionary gets whole block at its end
+void LZ::advance(int &i, int n) {
+    while (n--) insert(i++);
+}
+
+// bytes of match position, rough cost of its bucket and extra bits
+static inline int posBytes(int dist) {
+    return dist < 0x100 ? 1 : dist < 0x10000 ? 2 : dist < 0x1000000 ? 3 : 4;
+}
+
+// recent positions, most recent first - index of dist or -1
+static inline int repIndex(const int *rep, int dist) {
+    for (int k = 0; k < ILZREPN; k++) if (rep[k] == dist) return k;
+    return -1;
+}
+
+// recent positions start from the nearest ones in every block
+static inline void repReset(int *rep) {
+    for (int k = 0; k < ILZREPN; k++) rep[k] = k + 1;
+}
+
+// recent positions after match at dist, dist moves to front and positions
+// before it move one place back, new one pushes out the oldest
+static inline void repUpdate(const int *src, int *dst, int dist) {
+    int k = repIndex(src, dist);
+    if (k < 0) k = ILZREPN - 1;
+    if (dst != src) memcpy(dst, src, sizeof(int) * ILZREPN);
+    for (; k > 0; k--) dst[k] = dst[k - 1];
+    dst[0] = dist;
+}
+
+// far matches pay for their 3 or 4 position bytes only when longer
+int LZ::minMatchLen(int dist) {
+    int pb = posBytes(dist);
+    return ILZMINML + 1 + (pb > 2 ? pb - 1 : 0);
+}
+
+// search for best match at i, from matches worth writing the one with
+// most bytes left after paying for position wins, recent positions cost
+// nothing and are checked first, long repeat match or run of previous
+// byte is taken without searching
+void LZ::findMatch(int i, LZMatch *m) {
+    int cnt, len, gain, best(0);
+    LZMatch *mtchs;
+    m->clear();
+    for (int k = 0; k < ILZREPN; k++) {
+        len = lz_mf->repLen(rep[k], i);
+        if (len >= ILZREPML && len > best) {
+            best   = m->len = len;
+            m->pos = rep[k];
+        }
+    }
+    if (best >= ILZNICEML) return;
+    if ((len = lz_mf->runLen(i)) >= ILZNICEML) {
+        m->pos = 1;
+        m->len = len;
+        return;
+    }
+    cnt = matchesAt(i, &mtchs);
+    for (int k = cnt - 1; k >= 0; k--) {
+        gain = mtchs[k].len - posBytes(mtchs[k].pos);
+        if (mtchs[k].len >= minMatchLen(mtchs[k].pos) && gain > best) {
+            best = gain;
+            m->copy(mtchs + k);
+        }
+    }
+}
+
+// write literal to stream
+void LZ::writeLiteral(Byte b) {
+    if (b >= ILZICN) {
+        out_bf[ILZIS][out_i[ILZIS]++] = b;
+    } else {
+        out_bf[ILZIS][out_i[ILZIS]++] = (Byte)(ILZIL);
+        out_bf[ILZLS][out_i[ILZLS]++] = b;
+    }
+}
+
+// write match to stream, recent position is written as its index and
+// other ones as bucket with extra bits, length always goes as bucket
+// and its extra bits come first
+void LZ::writeMatch(LZMatch *m) {
+    int   k = repIndex(rep, m->pos), b;
+    DWord v = DWord(m->len - ILZREPML);
+    repUpdate(rep, rep, m->pos);
+    out_bf[ILZIS][out_i[ILZIS]++] = (Byte)(k >= 0 ? ILZIR1 + k : ILZIM);
+    b = len_bkt.bucket(v);
+    out_bf[ILZMLS][out_i[ILZMLS]++] = (Byte)(b);
+    bit_stream->writeBits(v - len_bkt.base[b], len_bkt.bits[b]);
+    if (k >= 0) return;
+    v = DWord(m->pos - 1);
+    b = pos_bkt.bucket(v);
+    out_bf[ILZMPS][out_i[ILZMPS]++] = (Byte)(b);
+    bit_stream->writeBits(v - pos_bkt.base[b], pos_bkt.bits[b]);
+}
+
+// estimated cost of literal and match in 1/ILZPRCSCL bits
+int LZ::literalPrice(Byte b) {
+    if (b >= ILZICN) return prc[ILZIS][b];
+    return prc[ILZIS][ILZIL] + prc[ILZLS][b];
+}
+int LZ::lengthPrice(int len) {
+    int b = len_bkt.bucket(DWord(len - ILZREPML));
+    return prc[ILZMLS][b] + len_bkt.bits[b] * ILZPRCSCL;
+}
+int LZ::matchPrice(int dist, int len) {
+    int b = pos_bkt.bucket(DWord(dist - 1));
+    return prc[ILZIS][ILZIM] + lengthPrice(len) +
+        prc[ILZMPS][b] + pos_bkt.bits[b] * ILZPRCSCL;
+}
+int LZ::repPrice(int k, int len) {
+    return prc[ILZIS][ILZIR1 + k] + lengthPrice(len);
+}
+
+// code lengths huffman will give to each stream are close to -log2(p),
+// block just written is used to predict the next one; extra bits cost
+// what they take
+void LZ::updatePrices() {
+    int hist[256];
+    for (int j = 0; j < ILZSN; j++) {
+        if (j == ILZXS) continue;
+        memset(hist, 0, sizeof(hist));
+        for (int k = 1; k < out_i[j]; k++) hist[out_bf[j][k]]++;
+        double tot = out_i[j] + 1.0;
+        for (int k = 0; k < 256; k++) {
+            int p = int(ILZPRCSCL * log2(tot / (hist[k] + 0.5)));
+            prc[j][k] = p < ILZPRCSCL ? ILZPRCSCL : p;
+        }
+    }
+}
+
+// take longest match at each position
+void LZ::parseGreedy() {
+    LZMatch m;
+    int i(0);
+    while (i < in_size) {
+        findMatch(i, &m);
+        if (m.len > ILZMINML) {
+            writeMatch(&m);
+            advance(i, m.len);
+        } else {
+            writeLiteral(in_bf[i]);
+            advance(i, 1);
+        }
+    }
+}
+
+// before writing match check if next position gives longer one, if so
+// write literal instead and try again from there
+void LZ::parseLazy() {
+    LZMatch m, next;
+    int i(0);
+    if (in_size > 0) findMatch(i, &m);
+    while (i < in_size) {
+        if (m.len > ILZMINML) {
+            advance(i, 1);
+            next.clear();
+            if (m.len < ILZNICEML && i < in_size) findMatch(i, &next);
+            if (next.len > m.len || (next.len == m.len && posBytes(next.pos) < posBytes(m.pos))) {
+                writeLiteral(in_bf[i - 1]);
+                m.copy(&next);
+                continue;
+            }
+            writeMatch(&m);
+            advance(i, m.len - 1);
+        } else {
+            writeLiteral(in_bf[i]);
+            advance(i, 1);
+        }
+        if (i < in_size) findMatch(i, &m);
+    }
+}
+
+// keep cheaper way of getting to position j + l, recent positions
+// are followed along the path
+void LZ::optRelax(int j, int l, int dist, int p) {
+    if (p >= opt_prc[j + l]) return;
+    opt_prc[j + l] = p;
+    opt_len[j + l] = l;
+    opt_dst[j + l] = dist;
+    if (l == 1) memcpy(opt_rep + (j + l) * ILZREPN, opt_rep + j * ILZREPN, sizeof(int) * ILZREPN);
+    else        repUpdate(opt_rep + j * ILZREPN, opt_rep + (j + l) * ILZREPN, dist);
+}
+
+// cheapest path through segment of positions, opt_prc[j] is the cost of
+// getting to position j, opt_len/opt_dst is the last step on that path,
+// run or match of ILZOPTLONG bytes ends segment and is written as it is
+void LZ::parseOptimal() {
+    LZMatch m, lng;
+    LZMatch *mtchs;
+    int i(0), seg, cnt, len, j, k, l, t, *rp;
+    while (i < in_size) {
+        seg = in_size - i < ILZOPTSEG ? in_size - i : ILZOPTSEG;
+        opt_prc[0] = 0;
+        for (j = 1; j <= seg; j++) opt_prc[j] = INT_MAX;
+        memcpy(opt_rep, rep, sizeof(rep));
+        lng.clear();
+
+        // relax every literal and match going forward from each position
+        for (j = 0; j < seg; j++) {
+            optRelax(j, 1, 0, opt_prc[j] + literalPrice(in_bf[i + j]));
+
+            // recent positions on the path to j
+            rp = opt_rep + j * ILZREPN;
+            for (k = 0; k < ILZREPN && lng.len == 0; k++) {
+                len = lz_mf->repLen(rp[k], i + j);
+                if (len >= ILZOPTLONG) {
+                    lng.pos = rp[k];
+                    lng.len = len;
+                }
+                if (len > seg - j) len = seg - j;
+                for (l = ILZREPML; l <= len; l++)
+                    optRelax(j, l, rp[k], opt_prc[j] + repPrice(k, l));
+            }
+            if (lng.len) break;
+
+            if ((len = lz_mf->runLen(i + j)) >= ILZOPTLONG) {
+                lng.pos = 1;
+                lng.len = len;
+                break;
+            }
+            cnt = matchesAt(i + j, &mtchs);
+            if (cnt > 0 && mtchs[cnt - 1].len >= ILZOPTLONG) {
+                lng.copy(mtchs + cnt - 1);
+                break;
+            }
+            l = ILZMINML + 1;
+            for (k = 0; k < cnt; k++) {
+                len = mtchs[k].len < seg - j ? mtchs[k].len : seg - j;
+                for (; l <= len; l++)
+                    optRelax(j, l, mtchs[k].pos, opt_prc[j] + matchPrice(mtchs[k].pos, l));
+            }
+            insert(i + j);
+        }
+
+        // walk back from the end of segment and write tokens in order
+        seg = j;
+        for (t = 0; j > 0; j -= opt_len[j], t++) {
+            tkn_len[t] = opt_len[j];
+            tkn_dst[t] = opt_dst[j];
+        }
+        for (j = i; t-- > 0; j += tkn_len[t]) {
+            if (tkn_len[t] == 1) {
+                writeLiteral(in_bf[j]);
+            } else {
+                m.len = tkn_len[t];
+                m.pos = tkn_dst[t];
+                writeMatch(&m);
+            }
+        }
+        i += seg;
+        if (lng.len) {
+            writeMatch(&lng);
+            advance(i, lng.len);
+        }
+    }
+}
+
 // compress block
 int LZ::compressBlock() {
-    int o[4], in_size(0), out_size(0), i(0);
+    int out_size(0);
     CodecBuffer *cb_in, *cb_out[ILZSN];
-    Byte *in, *out[ILZSN];
    
     // find raw buffer to compress
     cb_in = codec_stream->find(CBT_RAW);
-    in    = cb_in->mem;
+    in_bf = cb_in->mem;
 
-    // find 4 empty buffers for output
-    // 0 -> instructions; 1 -> pos; 2 -> len; 3 ->literal;
+    // find empty buffers for output
+    // 0 -> instructions; 1 -> pos; 2 -> len; 3 ->literal; 4 -> extra bits;
     for (int j = 0; j < ILZSN; j++) {
-        o     [j]       = 0;
+        out_i [j]       = 0;
         cb_out[j]       = codec_stream->find(CBT_EMPTY); 
         cb_out[j]->type = CBT_LZ;
-        out   [j]       = cb_out[j]->mem;
+        out_bf[j]       = cb_out[j]->mem;
 
         // first byte of buffer is buffer type
-        out[j][o[j]++]  = Byte(j);
+        out_bf[j][out_i[j]++] = Byte(j);
     }
 
     // input stream after compression will be empty
     cb_in->type = CBT_EMPTY;
     in_size     = cb_in->size;
 
-    // assign buffer to match finder, write input size int 1 stream
-    lz_mf->assignBuffer(in, in_size, lz_buf);
-    o[ILZMPS] += write32To8Buf(out[ILZMPS] + o[ILZMPS], in_size);
-   
-    match_empty.clear();
-    lz_match = &match_empty;
+    // assign buffer to match finder, write input size into extra bits
+    lz_mf->assignBuffer(in_bf, in_size, lz_buf);
+    bit_stream->assignBuffer(out_bf[ILZXS] + out_i[ILZXS], cb_out[ILZXS]->cap - out_i[ILZXS]);
+    bit_stream->writeBits(in_size, 32);
+    repReset(rep);
+    if (mtch_pool) searchBlock();
 
-    while (i < in_size) {
-
-        // search for best match
-        if (i + int(cdc_sttgs->byte_lkp_hsh) > in_size) {
-            lz_match->len   = 0;
-        } else {
-            lz_match   = lz_mf->find(i);
-        }
-
-        if ((lz_match->len > ILZMINML) &&
-            (lz_match->len + lz_match->pos + int(cdc_sttgs->byte_lkp_hsh)) < in_size) {
-
-            // write match to stream
-            lz_match->pos = lz_buf->convPos(true, lz_match->pos);
-            if (lz_match->pos < 256) {
-                out[ILZIS] [o[ILZIS] ++] = (Byte)(ILZIM1);
-                out[ILZMLS][o[ILZMLS]++] = (Byte)(lz_match->len);
-                out[ILZMPS][o[ILZMPS]++] = (Byte)(lz_match->pos);
-            } else {
-                out[ILZIS] [o[ILZIS] ++] = (Byte)(ILZIM2);
-                out[ILZMLS][o[ILZMLS]++] = (Byte)(lz_match->len);
-                o[ILZMPS] += write16To8Buf(out[ILZMPS] + o[ILZMPS], Word(lz_match->pos));
-            }
-            // add skipped bytes into dictionary
-            while (lz_match->len--) {
-                lz_mf->insert(i);
-                lz_buf->putByte(in[i++]);
-            }
-        } else {
-            if (in[i] != ILZIM1 && in[i] != ILZIM2 && in[i] != ILZIL) {
-                out[ILZIS][o[ILZIS]++] = in[i];
-            } else {
-                // write literal
-                out[ILZIS][o[ILZIS]++] = (Byte)(ILZIL);
-                out[ILZLS][o[ILZLS]++] = (Byte)(in[i]);
-            }
-            // add byte into dictionary
-            lz_mf->insert(i);
-            lz_buf->putByte(in[i++]);
-        }
+    // split block into literals and matches
+    switch (cdc_sttgs->prs_strtgy) {
+        case PS_GREEDY:  parseGreedy();  break;
+        case PS_LAZY:    parseLazy();    break;
+        case PS_OPTIMAL: parseOptimal(); updatePrices(); break;
     }
+    lz_buf->putBlock(in_bf, in_size);
+    bit_stream->flush();
+    out_i[ILZXS] += bit_stream->getBytePos();
 
     // set output buffer sizes
     for (int j = 0; j < ILZSN; j++) {
-        out_size       += o[j];
-        cb_out[j]->size = o[j];
+        out_size       += out_i[j];
+        cb_out[j]->size = out_i[j];
     }
 
     // update processed bytes length
@@ -257,82 +967,162 @@ int LZ::compressBlock() {
     return out_size;
 }
 
-// decompress block
+// decompress block, coded streams are pulled from their coders in rounds
+// while instructions go, so whole of them is never decoded
 int LZ::decompressBlock() {
-    int i[ILZSN], dec_size(0);
-    CodecBuffer *cb_out, *cb_in[ILZSN];
-    Byte *out, *temp_in[ILZSN], *in[ILZSN];
+    int dec_size(0), cnt(0), pos, len, o, b, n, np, nm, nl;
+    CodecBuffer *cb_out, *cb_xs, *cb_in[ILZSN];
+    LZWindow *ws[ILZSN];
+    Byte *out, *dst, *src, *end, *wild, *is, *is_end, *ps, *ms, *ls, c;
+    QWord w, low;
+    BitStream xs;
+    bool pull(false);
 
-    // find empty buffer for output
-    cb_out = codec_stream->find(CBT_EMPTY);
-    out = cb_out->mem;
+    // find empty buffer for output, output will be raw data
+    cb_out       = codec_stream->find(CBT_EMPTY);
+    cb_out->type = CBT_RAW;
+    out          = cb_out->mem;
 
-    // find 4 lz input buffers
-    for (int j = 0; j < ILZSN; j++) {
-        cb_in  [j]       = codec_stream->find(CBT_LZ);
-        cb_in  [j]->type = CBT_EMPTY;
-        temp_in[j]       = cb_in[j]->mem;
-        in     [j]       = nullptr;
-        i      [j]       = 1;
+    // open windows of lz streams and sort them by their function, it's
+    // their first symbol
+    // 0 -> instructions; 1 -> pos; 2 -> len; 3 ->literal; 4 -> extra bits;
+    for (int j = 0; j < ILZSN; j++) ws[j] = win + j;
+    for (int j = 0; j < codec_stream->buf_count && cnt < ILZSN; j++) {
+        CodecBuffer *cb = codec_stream->buf_stack + j;
+        if (cb->type != CBT_LZ && cb->type != CBT_PULL) continue;
+        cb_in[cnt] = cb;
+        win  [cnt].open(cb);
+        win  [cnt].fill(1);
+        pull |= win[cnt].src != nullptr;
+        if (win[cnt].cur < win[cnt].end && (c = *win[cnt].cur++) < ILZSN) ws[c] = win + cnt;
+        total_in += win[cnt++].size;
     }
+    for (int j = cnt; j < ILZSN; j++) win[j].open(nullptr);
 
-    // output will be raw data
-    cb_out->type = CBT_RAW;
-
-    // sort buffers by their function
-    // 0 -> instructions; 1 -> pos; 2 -> len; 3 ->literal;
-    for (int k = 0; k < ILZSN; k++)
-        for (int j = 0; j < ILZSN; j++)
-            if (temp_in[k][0] == j)
-                in[j] = temp_in[k];
+    // extra bits are read as one bit stream, coded one is pulled whole
+    if (ws[ILZXS]->src) {
+        cb_xs = codec_stream->find(CBT_EMPTY);
+        n     = int(ws[ILZXS]->end - ws[ILZXS]->cur);
+        memcpy(cb_xs->mem, ws[ILZXS]->cur, n);
+        while ((b = ws[ILZXS]->src->pullSymbols(cb_xs->mem + n)) > 0) n += b;
+        xs.assignBuffer(cb_xs->mem, n);
+    } else {
+        xs.assignBuffer(ws[ILZXS]->cur, int(ws[ILZXS]->end - ws[ILZXS]->cur));
+    }
 
     // read uncompressed size
-    dec_size = read32From8Buf(in[ILZMPS] + i[ILZMPS]);
-    i[ILZMPS] += sizeof(DWord);
-
-    for (int o = 0; o < dec_size; ) {
-        Byte c = in[ILZIS][i[ILZIS]++];
-
-        // what to do?
-        if (c == ILZIM1 || c == ILZIM2) {
-            int pos(0), len(0);
-            
-            // read match
-            if (c == ILZIM2) {
-                pos = read16From8Buf(in[ILZMPS] + i[ILZMPS]);
-                i[ILZMPS] += sizeof(Word);
-            } else if (c == ILZIM1) {
-                pos = in[ILZMPS][i[ILZMPS]++];
-            }
-            pos = lz_buf->convPos(false, pos);
-            len = in[ILZMLS][i[ILZMLS]++];
-
-            // copy match
-            for (int j = 0; j < len; j++) {
-                Byte b       = lz_buf->getByte(pos + j);
-                tmp_btebf[j] = b;
-                out[o++]     = b;
+    dec_size = xs.readBits(32);
+    repReset(rep);
+
+    // matches ending before wild can be copied in ILZWILD byte steps
+    // writing past their end
+    dst  = out;
+    end  = out + dec_size;
+    wild = out + cb_out->cap - ILZWILD;
+
+    while (dst < end) {
+
+        // next chunk of instructions, streams it reads are pulled far
+        // enough so it is decoded without checking them
+        ws[ILZIS]->fill(1);
+        is     = ws[ILZIS]->cur;
+        is_end = ws[ILZIS]->end - is > CDCROUND ? is + CDCROUND : ws[ILZIS]->end;
+        if (is == is_end) break;
+        if (pull) {
+            np = nm = nl = 0;
+            for (Byte *p = is; p < is_end; p++) {
+                np += *p == ILZIM;
+                nm += *p <  ILZIL;
+                nl += *p == ILZIL;
             }
+            ws[ILZMPS]->fill(np);
+            ws[ILZMLS]->fill(nm);
+            ws[ILZLS] ->fill(nl);
+        }
+        ps = ws[ILZMPS]->cur;
+        ms = ws[ILZMLS]->cur;
+        ls = ws[ILZLS] ->cur;
 
-            // insert processed bytes into dictionary
-            for (int j = 0; j < len; j++)  lz_buf->putByte(tmp_btebf[j]);
-            
-        } else if (c == ILZIL) {
-            // read uncompressed byte
-            lz_buf->putByte(in[ILZLS][i[ILZLS]]);
-            out[o++] = in[ILZLS][i[ILZLS]++];
-        } else {
-            lz_buf->putByte(c);
-            out[o++] = c;
+        while (is < is_end && dst < end) {
+            c = *is++;
+
+            // run of literals, 8 at once until one of them is escaped or
+            // instruction, lowest byte below ILZICN is found by word arithmetic
+            if (c >= ILZICN) {
+                *dst++ = c;
+                while (is + 8 <= is_end && dst + 8 <= end) {
+                    memcpy(&w, is, 8);
+                    memcpy(dst, &w, 8);
+                    low = (w - 0x0101010101010101ULL * ILZICN) & ~w & 0x8080808080808080ULL;
+                    if (low) {
+                        dst += ctz64(low) >> 3;
+                        is  += ctz64(low) >> 3;
+                        break;
+                    }
+                    dst += 8;
+                    is  += 8;
+                }
+
+            } else if (c < ILZIL) {
+                // read match, length and new position are bucket and extra
+                // bits found by table lookup, instruction only tells which of
+                // recent positions is used again; encoder never writes recent
+                // position in full so new one pushes out oldest
+                int k;
+                xs.refill();
+                b   = *ms++;
+                len = int(len_bkt.base[b] + xs.peekBits(len_bkt.bits[b])) + ILZREPML;
+                xs.consume(len_bkt.bits[b]);
+                if (c >= ILZIR1) {
+                    k   = c - ILZIR1;
+                    pos = rep[k];
+                } else {
+                    k   = ILZREPN - 1;
+                    b   = *ps++;
+                    xs.refill();
+                    pos = int(pos_bkt.base[b] + xs.peekBits(pos_bkt.bits[b])) + 1;
+                    xs.consume(pos_bkt.bits[b]);
+                }
+                for (; k > 0; k--) rep[k] = rep[k - 1];
+                rep[0] = pos;
+
+                // copy match, damaged stream can't write past the block
+                o = int(dst - out);
+                if (DWord(len) > DWord(dec_size - o)) len = dec_size - o;
+                if (pos <= 0) pos = 1;
+                if (pos <= o && pos >= ILZWILD && dst + len <= wild) {
+                    src = dst - pos;
+                    for (Byte *d = dst; d < dst + len; d += ILZWILD, src += ILZWILD)
+                        memcpy(d, src, ILZWILD);
+                } else {
+                    lz_buf->copyMatch(out, o, pos, len);
+                }
+                dst += len;
+
+            } else {
+                // read uncompressed byte
+                *dst++ = *ls++;
+            }
         }
+        ws[ILZIS] ->cur = is;
+        ws[ILZMPS]->cur = ps;
+        ws[ILZMLS]->cur = ms;
+        ws[ILZLS] ->cur = ls;
     }
 
-    // update info
-    for (int j = 0; j < ILZSN; j++) {
-        total_in += i[j];
-    }
+    // insert processed bytes into dictionary, input buffers are free
+    lz_buf->putBlock(out, dec_size);
+    for (int j = 0; j < cnt; j++) cb_in[j]->type = CBT_EMPTY;
 
+    // update info
     total_out   += dec_size;
     cb_out->size = dec_size;
     return dec_size;
 }
+
+// block skipped by LZ goes to dictionary only, its positions aren't
+// inserted into match finder
+void LZ::passBlock(Byte *buf, int size) {
+    lz_mf->assignBuffer(buf, size, lz_buf);
+    lz_buf->putBlock(buf, size);
+}
@@ -8,43 +8,103 @@
 #ifndef LZHX_LZ_H
 #define LZHX_LZ_H
 
+// stl
+#include <vector>
+
 // LZHX
 #include "Types.h"
 #include "BitStream.h"
 
 // number of LZ streams
-#define ILZSN  4
+#define ILZSN  5
 
 // IDs
 #define ILZIS  0 // instruction stream
-#define ILZMPS 1 // match pos stream
-#define ILZMLS 2 // match len stream
+#define ILZMPS 1 // match pos bucket stream
+#define ILZMLS 2 // match len bucket stream
 #define ILZLS  3 // literal stream
+#define ILZXS  4 // extra bits stream, block size and low bits of buckets
 
 // LZ instructions
-#define ILZIM1 0 // match 1 
-#define ILZIM2 1 // match 2
-#define ILZIL  2 // literal
+#define ILZIM  0 // match, position bucket follows in match pos stream
+#define ILZIR1 1 // repeat match, last used position
+#define ILZIR2 2 // repeat match, 2nd last used position
+#define ILZIR3 3 // repeat match, 3rd last used position
+#define ILZIR4 4 // repeat match, 4th last used position
+#define ILZIL  5 // literal
+#define ILZICN 6 // instruction count, literals below it are escaped
+
+// buckets, values below 1 << direct bits are buckets of their own
+#define ILZBKTN   256 // bucket table size, one stream byte indexes it
+#define ILZPOSDIR 2   // direct bits of position - 1
+#define ILZLENDIR 5   // direct bits of length - ILZREPML
 
 // others
-#define ILZMINML 4 // minimum match len
+#define ILZMINML  4    // minimum match len
+#define ILZREPN   4    // number of recent positions kept for repeat matches
+#define ILZREPML  3    // minimum repeat match len
+#define ILZNICEML 32   // match long enough to skip lazy evaluation
+#define ILZTREEML 256  // longest suffix compared while walking binary tree
+#define ILZOPTLONG 256 // match long enough to end optimal parser segment
+#define ILZWILD   16   // decoder copy step, may write that much past match end
+#define ILZOPTSEG 4096 // optimal parser segment length
+#define ILZPRCSCL 16   // price units per bit
+#define ILZMTSEG 16384 // block segment searched by one task of parallel match search
+#define ILZREBASE 0x80000000 // position from which reset rebases finder to 0 and clears it
 
 namespace LZHX {
 
-// dictionary buffer
+class ThreadPool;
+
+// common prefix length of a and b up to lim bytes, compares 32, 16 or
+// 8 bytes per step depending on cpu (AVX2, SSE2 or plain 64 bit words)
+int matchLength(const Byte *a, const Byte *b, int lim);
+
+// dictionary buffer - ring with first mirr bytes repeated after its end
+// so any match up to mirr bytes long can be read without wrapping, it
+// holds stream up to the start of current block and is updated once per
+// block
 class LZDictionaryBuffer {
 public:
     Byte *arr;
-    int pos, size, cap;
-    LZDictionaryBuffer(int cap);
+    int pos, size, cap, mirr;
+    LZDictionaryBuffer(int cap, int mirr);
     ~LZDictionaryBuffer();
     Byte *putByte(Byte val);
+    void  putBlock(const Byte *src, int n);
+    void  rewind();
+    void  copyTo(Byte *dst, int back, int n);
+    void  copyMatch(Byte *out, int o, int dist, int len);
     Byte  getByte(int p);
     int   getPos();
-    int   convPos(bool absToRel, int pos);
 };
 
-// lz match 
+// deflate style log2 buckets - value is written as bucket of its bit
+// width and the bit below the top one, bits under them follow as extra
+// bits, so decoder gets value as base[b] + extra bits[b] wide
+class LZBuckets {
+public:
+    DWord base[ILZBKTN];
+    Byte  bits[ILZBKTN];
+    int   direct;
+    LZBuckets(int direct);
+    int   bucket(DWord v);
+};
+
+// stream window of fused decoding - coded stream is pulled from its coder
+// into mem in rounds, decoded or stored one is read in place
+class LZWindow {
+public:
+    Byte *cur, *end, *mem;
+    int   size;
+    CodecInterface *src;
+    LZWindow();
+    ~LZWindow();
+    void open(CodecBuffer *cb);
+    void fill(int n);
+};
+
+// lz match, pos is distance back from current position
 class LZMatch {
 public:
     int pos, len;
@@ -53,32 +113,69 @@ public:
     void copy(LZMatch *lzm);
 };
 
-// lz lookup table node
-class LZDictionaryNode {
-public:
-    int pos;
-    bool valid;
-    LZDictionaryNode *next, *prev;
-    LZDictionaryNode();
-    void clear();
-};
-
-// lz match finder
+// lz match finder base - keeps current block, dictionary and absolute
+// stream position, derived finders fill list of matches with growing
+// lengths, last one is the best; stream starts at blk_floor, positions
+// below it are left from streams before reset and count as empty
 class LZMatchFinder {
-private:
-    int dict_i, buf_size;
+protected:
+    int buf_size, mtch_cnt;
+    DWord blk_base, blk_floor, hsh_shift;
+    QWord hsh_mask;
     Byte               *buf;
     CodecSettings      *cdc_sttgs;
     LZDictionaryBuffer *lz_buf;
-    LZDictionaryNode   *lkp_tab, *dict_tab;
-    LZMatch            *best_match;
+    LZMatch            *matches, match_empty;
+    int  maxLen(int pos);
+    int  streamLen(int dist, int pos, int len, int max_len);
+    Byte streamByte(int dist, int pos, int i);
+    virtual void clear() = 0;
 public:
     LZMatchFinder(CodecSettings *cdc_sttgs);
-    ~LZMatchFinder();
+    virtual ~LZMatchFinder();
     void assignBuffer(Byte *buf, int buf_size, LZDictionaryBuffer *lz_buf);
-    int  hash(Byte *in);
-    void insert(int pos);
+    bool reset();
+    int  hash(Byte *in, int avail);
     LZMatch *find(int pos);
+    LZMatch *getMatches();
+    int  runLen(int pos);
+    int  repLen(int dist, int pos);
+    virtual void insert (int pos) = 0;
+    virtual int  findAll(int pos) = 0;
+};
+
+// hash chains kept in two flat arrays, head[] indexed by hash and prev[]
+// indexed by window position, both holding absolute positions + 1
+// (0 means empty slot); position already inserted can be searched from
+// its own link, which doesn't change the chains, so many threads can do
+// it at once
+class LZHashChain : public LZMatchFinder {
+private:
+    DWord *head, *prev;
+    int  search(int pos, DWord cand, LZMatch *out);
+    void clear();
+public:
+    LZHashChain(CodecSettings *cdc_sttgs);
+    ~LZHashChain();
+    void insert (int pos);
+    int  findAll(int pos);
+    int  findInserted(int pos, LZMatch *out);
+};
+
+// binary search trees of suffixes, one tree per hash bucket, node
+// children kept in son[] (2 per window position), searching and
+// inserting is done in one pass like in LZMA BT4 match finder
+class LZBinaryTree : public LZMatchFinder {
+private:
+    DWord  last_abs;
+    DWord *head, *son;
+    int  update(int pos, bool collect);
+    void clear();
+public:
+    LZBinaryTree(CodecSettings *cdc_sttgs);
+    ~LZBinaryTree();
+    void insert (int pos);
+    int  findAll(int pos);
 };
 
 // lz algorithm main class
@@ -89,11 +186,36 @@ private:
     CodecSettings      *cdc_sttgs;
     BitStream          *bit_stream;
     LZMatchFinder      *lz_mf;
-    LZMatch             match_empty;
-    LZMatch            *lz_match;
-    LZMatch            *rolz_match;
+    LZHashChain        *lz_hc;
     LZDictionaryBuffer *lz_buf;
-    Byte               *tmp_btebf;
+    LZBuckets           pos_bkt, len_bkt;
+    LZWindow            win[ILZSN];
+    // compression state shared by parsers
+    int   in_size, out_i[ILZSN], rep[ILZREPN];
+    Byte *in_bf, *out_bf[ILZSN];
+    int  *prc[ILZSN], *opt_prc, *opt_len, *opt_dst, *opt_rep, *tkn_len, *tkn_dst;
+    // matches of whole block searched ahead by threads, segment by segment
+    ThreadPool *mtch_pool;
+    std::vector<std::vector<LZMatch>> pre_mtch;
+    int  *pre_off, *pre_cnt;
+    void searchSegment(int seg);
+    void searchBlock();
+    int  matchesAt(int i, LZMatch **mtchs);
+    void insert(int i);
+    void advance(int &i, int n);
+    void findMatch(int i, LZMatch *m);
+    int  minMatchLen(int dist);
+    void writeLiteral(Byte b);
+    void writeMatch(LZMatch *m);
+    int  literalPrice(Byte b);
+    int  lengthPrice(int len);
+    int  matchPrice(int dist, int len);
+    int  repPrice(int k, int len);
+    void updatePrices();
+    void optRelax(int j, int l, int dist, int p);
+    void parseGreedy();
+    void parseLazy();
+    void parseOptimal();
 public:
     LZ(CodecSettings *cdc_sttgs);
     ~LZ();
@@ -103,6 +225,8 @@ public:
     void initStream(CodecStream *codec_stream);
     int  compressBlock();
     int  decompressBlock();
+    void passBlock(Byte *buf, int size);
+    void reset();
 };
 
 } // namespace
@@ -13,9 +13,13 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <future>
+#include <chrono>
 
 // c
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
 #include <ctime>
 
@@ -25,7 +29,12 @@
 #include "Utils.h"
 #include "BitStream.h"
 #include "Huffman.h"
+#include "ANS.h"
+#include "CM.h"
 #include "LZ.h"
+#include "ROLZ.h"
+#include "Context.h"
+#include "Threads.h"
 
 // namespaces
 using namespace std;
@@ -36,57 +45,180 @@ namespace LZHX {
 class LZHX {
 private:
     string                  curr_f_name;
+    string                  curr_f_path;
     clock_t                 c_begin;
     QWord                   total_input, total_output;
-    CodecBuffer            *cdc_bffrs;
-    CodecStream             cdc_strm;
-    CodecInterface         *lz_cdc, *hf_cdc;
+    int                     strm_size, threads;
+    CodecBuffer             io_bfs[2][io_bufs];
+    CodecContext           *ctx;
+    vector<CodecContext*>   wrk_ctx;
+    vector<fstream>         wrk_out;
+    ThreadPool             *pool;
     CodecSettings          *sttgs;
     CodecCallbackInterface *cdc_cllbck;
 
-    // function for counting working buffer size
-    int outBlkSize(int inBlkSize) { return inBlkSize * 2; }
-    
-    // init archiving
-    void init() {
-        cdc_strm.buf_count = sttgs->byte_bffr_cnt;
-        cdc_strm.buf_stack = cdc_bffrs;
-        for (int i = 0; i < int(sttgs->byte_bffr_cnt); i++) {
-            cdc_bffrs[i].size = 0;
-            cdc_bffrs[i].type = CBT_EMPTY;
+    // chunk of file coded by one worker, its coded blocks are collected
+    // in out and written when all chunks before it are; decoded chunk
+    // goes to pos of output file, key is where its decryption starts
+    struct Chunk {
+        vector<Byte>  in, out;
+        DWord         hash;
+        int           key;
+        QWord         pos;
+        promise<void> done;
+        future<void>  ready;
+    };
+
+    // file of chunked archive between reader and writer, whole one has all
+    // chunks coded when writer gets to it and its header is written final
+    // at once, header of other one is rewritten at its end; file hash is
+    // hash of its chunk hashes, so workers can count them
+    struct FileJob {
+        string     name;
+        FileHeader fh;
+        deque<shared_ptr<Chunk>> chunks;
+        vector<ChunkHeader>      idx;
+        bool       read, started, whole;
+        int        tot_in, tot_out;
+        QWord      h_pos;
+    };
+    QWord pend_in; // raw buffers of chunks which aren't written yet, by capacity
+
+    // free codec contexts and workers, workers finish their chunks first
+    void release() {
+        if (pool) delete pool;
+        for (auto c : wrk_ctx) delete c;
+        wrk_ctx.clear();
+        wrk_out.clear();
+        if (ctx) delete ctx;
+        for (int i = 0; i < io_bufs; i++) {
+            delete[] io_bfs[0][i].mem;
+            delete[] io_bfs[1][i].mem;
+            io_bfs[0][i].mem = io_bfs[1][i].mem = nullptr;
+        }
+        pool = nullptr;
+        ctx  = nullptr;
+    }
+
+    // create codec context for current settings, called after settings
+    // are known - chosen level or read from archive; chunked files are
+    // compressed by workers with a context each
+    void configure(bool workers = false) {
+        release();
+        ctx        = new CodecContext(sttgs);
+        for (int i = 0; i < io_bufs; i++) {
+            io_bfs[0][i].cap = io_bfs[1][i].cap = ctx->codedCap();
+            for (int j = 0; j < 2; j++) {
+                io_bfs[j][i].mem  = new Byte[io_bfs[j][i].cap];
+                io_bfs[j][i].size = 0;
+                io_bfs[j][i].src  = nullptr;
+            }
+        }
+        if (workers && sttgs->byte_chnk_cap) {
+            pool = new ThreadPool(threads);
+            for (int i = 0; i < pool->size(); i++)
+                wrk_ctx.push_back(new CodecContext(sttgs));
+        }
+    }
+
+    // read one coded block into bf as it is - block type followed by
+    // stored data or by its streams with their sizes and coders
+    int readBlock(ifstream &ifile, CodecBuffer *bf) {
+        Byte *p = bf->mem + sizeof(Byte);
+        int size, n;
+        readAndDecrypt(ifile, (char*)bf->mem, sizeof(Byte));
+        if (bf->mem[0] == BT_RAW) {
+            readAndDecrypt(ifile, (char*)p, sizeof(int));
+            memcpy(&size, p, sizeof(int));
+            readAndDecrypt(ifile, (char*)p + sizeof(int), size);
+            p += sizeof(int) + size;
+        } else {
+            n = bf->mem[0] == BT_ENT ? 1 : ILZSN;
+            for (int i = 0; i < n; i++) {
+                readAndDecrypt(ifile, (char*)p, sizeof(int) + sizeof(Byte));
+                memcpy(&size, p, sizeof(int));
+                readAndDecrypt(ifile, (char*)p + sizeof(int) + sizeof(Byte), size);
+                p += sizeof(int) + sizeof(Byte) + size;
+            }
+        }
+        bf->size = int(p - bf->mem);
+        return bf->size;
+    }
+
+    // code chunk with context of worker, chunk doesn't see history of
+    // chunks before it, so its coded form doesn't depend on which worker
+    // took it or when
+    void compressChunk(Chunk *c, CodecContext *cc) {
+        try {
+            c->hash = fnvHash(c->in.data(), int(c->in.size()));
+            cc->restart();
+            for (int p = 0; p < int(c->in.size()); p += cc->blockCap()) {
+                int n = int(c->in.size()) - p;
+                CodecBuffer *blk = cc->compressBlock(c->in.data() + p, n < cc->blockCap() ? n : cc->blockCap());
+                c->out.insert(c->out.end(), blk->mem, blk->mem + blk->size);
+            }
+            c->done.set_value();
+        } catch (...) {
+            c->done.set_exception(current_exception());
+        }
+    }
+
+    // wait for chunk, write its blocks and add it to index of file
+    int writeChunk(ofstream &ofile, Chunk *c, vector<ChunkHeader> &idx) {
+        ChunkHeader ch;
+        c->ready.get();
+        ch.c_cmp_size = DWord(c->out.size());
+        ch.c_dcm_size = DWord(c->in.size());
+        idx.push_back(ch);
+        encryptAndWrite(ofile, (char*)c->out.data(), int(c->out.size()));
+        return int(c->out.size());
+    }
+
+    // chunk is ready when its worker is done with it
+    bool isReady(Chunk *c) {
+        return c->ready.wait_for(chrono::seconds(0)) == future_status::ready;
+    }
+
+    // decode chunk with context of worker w and write it straight to its
+    // place in output file through handle of that worker
+    void decompressChunk(Chunk *c, int w) {
+        int used;
+        CodecBuffer  *raw_bf;
+        CodecContext *cc    = wrk_ctx[w];
+        fstream      &ofile = wrk_out[w];
+        try {
+            decryptBuf(c->in.data(), int(c->in.size()), c->key);
+            cc->restart();
+            for (int p = 0; p < int(c->in.size()); p += used) {
+                raw_bf = cc->decompressBlock(c->in.data() + p, &used);
+                c->out.insert(c->out.end(), raw_bf->mem, raw_bf->mem + raw_bf->size);
+                raw_bf->type = CBT_EMPTY;
+            }
+            c->hash = fnvHash(c->out.data(), int(c->out.size()));
+            ofile.seekp(c->pos);
+            ofile.write((char*)c->out.data(), c->out.size());
+            if (!ofile.good()) throw string(S_ERR_FOPN);
+            c->done.set_value();
+        } catch (...) {
+            c->done.set_exception(current_exception());
         }
     }
 public:
     LZHX(CodecSettings *sttgs) {
-        cdc_bffrs = new CodecBuffer[sttgs->byte_bffr_cnt];
-        for (int i = 0; i < int(sttgs->byte_bffr_cnt); i++) {
-            cdc_bffrs[i].cap = outBlkSize(sttgs->byte_blk_cap);
-            cdc_bffrs[i].mem = new Byte[cdc_bffrs[i].cap];
-            cdc_bffrs[i].type = CBT_EMPTY;
-            cdc_bffrs[i].size = 0;
-        }
         this->sttgs = sttgs;
-        lz_cdc = hf_cdc = nullptr;
+        for (int i = 0; i < io_bufs; i++) io_bfs[0][i].mem = io_bfs[1][i].mem = nullptr;
+        ctx             = nullptr;
+        pool            = nullptr;
+        threads         = defaultThreads();
         cdc_cllbck      = nullptr;
         curr_f_name     = S_EMPTY;
         total_input = total_output = 0;
-        
-    }
-    ~LZHX() {
-        for (int i = 0; i < int(sttgs->byte_bffr_cnt); i++) {
-            delete [] cdc_bffrs[i].mem;
-        }
-        delete[] cdc_bffrs;
-    }
-    void setCodec(CodecInterface *codec) {
-        if (codec == nullptr) return;
-        switch (codec->getCodecType()) {
-            case CT_LZ: lz_cdc = codec; break;
-            case CT_HF: hf_cdc = codec; break;
-        }
+        strm_size   = 0;
     }
+    ~LZHX() { release(); }
     void setCallback(CodecCallbackInterface  *codec_callback) {
         this->cdc_cllbck = codec_callback; }
+    void setThreads(int count) { threads = count > 0 ? count : defaultThreads(); }
 
 private:
     DWord f_hash;
@@ -113,14 +245,26 @@ private:
     DWord  encrypted_hash;
     string e_key;
 
-    // encryption functions 
+    // encryption functions, byte is encrypted with key at its position
+    // in archive data
+    Byte cryptByte(Byte b, int pos) {
+        char c = e_key[pos % key_size];
+        return Byte(b ^ c ^ ((pos + 1) * 3) ^ (c * 5));
+    }
     Byte encryptByte(Byte b) {
-        char c = e_key[key_pos++ % key_size];
-        return Byte(b ^ c ^ (key_pos * 3) ^ (c * 5));
+        return cryptByte(b, key_pos++);
     }
     Byte decryptByte(Byte b) {
         return encryptByte(b);
     }
+
+    // decrypt buffer starting at pos, doesn't move key
+    void decryptBuf(Byte *buf, int size, int pos) {
+        if (do_encrypt) {
+            for (int i = 0; i < size; i++)
+                buf[i] = cryptByte(buf[i], pos + i);
+        }
+    }
 public:
     // init encryption
     void initEncryption(bool de, ifstream *arch, ofstream *arch2) {
@@ -177,56 +321,75 @@ public:
 
 public:
 
-    // compress file
+    // compress file, solid one block after block in three stages - reader
+    // thread reads and hashes raw blocks, they are coded here and writer
+    // thread encrypts and writes them; buffers come back to stage which
+    // fills them through free queue, so no stage can run more than io_bufs
+    // blocks ahead
     int compressFile(ifstream &ifile, ofstream &ofile) {
-        int tot_in(0), tot_out(0), cc(0), temp_s(0);
-        CodecBuffer *empty_bf, *lz_bf, *hf_bf;
+        int tot_in(0), tot_out(0), cc(0);
+        CodecBuffer *bf, *blk;
+        BoundedQueue<CodecBuffer*> raw(io_bufs), raw_free(io_bufs), cod(io_bufs), cod_free(io_bufs);
+        auto stop = [&]() { raw.close(); raw_free.close(); cod.close(); cod_free.close(); };
+        for (int i = 0; i < io_bufs; i++) {
+            raw_free.push(io_bfs[0] + i);
+            cod_free.push(io_bfs[1] + i);
+        }
 
         // init compression
-        init();
-        lz_cdc->initStream(&cdc_strm);
-        hf_cdc->initStream(&cdc_strm);
-
-        while(ifile.good())
-        {
-            // find empty buffer and read raw data into it
-            empty_bf = cdc_strm.find(CBT_EMPTY);
-            readAndHash(ifile, (char*)empty_bf->mem, sttgs->byte_blk_cap);
-            empty_bf->size = (int)ifile.gcount(); empty_bf->type = CBT_RAW;
-            tot_in += empty_bf->size;
-
-            // compress block with LZ
-            lz_cdc->compressBlock();
-
-            // compress 4 LZ streams with huffman
-            lz_bf = cdc_strm.find(CBT_LZ);
-            while (lz_bf) {
-
-                // compress
-                hf_cdc->compressBlock();
-                hf_bf = cdc_strm.find(CBT_HF);
-                temp_s = hf_bf->size;
-
-                // write compressed block size and compressed data
-                encryptAndWrite(ofile, (char*)&temp_s, sizeof(int));
-                encryptAndWrite(ofile, (char*)hf_bf->mem, hf_bf->size);
-
-                // update info
-                tot_out += sizeof(int) + hf_bf->size;
-                hf_bf->type = CBT_EMPTY;
-                lz_bf = cdc_strm.find(CBT_LZ);
+        ctx->init();
+
+        // read blocks, the last one is read at the end of file, even if
+        // it's empty
+        StageThread reader([&]() {
+            CodecBuffer *rb;
+            while (ifile.good() && raw_free.pop(rb)) {
+                readAndHash(ifile, (char*)rb->mem, ctx->blockCap());
+                rb->size = (int)ifile.gcount();
+                raw.push(rb);
             }
-
-            // callback
-            if (cdc_cllbck != nullptr && !(cc++ % 10))
-                cdc_cllbck->compressCallback(lz_cdc->getTotalIn(), hf_cdc->getTotalOut(),
-                    cdc_strm.stream_size, curr_f_name.c_str());
+            raw.close();
+        }, stop);
+
+        // write block type and its streams or stored data
+        StageThread writer([&]() {
+            CodecBuffer *wb;
+            while (cod.pop(wb)) {
+                encryptAndWrite(ofile, (char*)wb->mem, wb->size);
+                cod_free.push(wb);
+            }
+        }, stop);
+
+        try {
+            while (raw.pop(bf)) {
+
+                // code block and hand it to writer
+                tot_in += bf->size;
+                blk = ctx->compressBlock(bf->mem, bf->size);
+                raw_free.push(bf);
+                if (!cod_free.pop(bf)) break;
+                memcpy(bf->mem, blk->mem, blk->size);
+                bf->size = blk->size;
+                cod.push(bf);
+                tot_out += blk->size;
+
+                // callback
+                if (cdc_cllbck != nullptr && !(cc++ % 10))
+                    cdc_cllbck->compressCallback(tot_in, tot_out,
+                        strm_size, curr_f_name.c_str());
+            }
+        } catch (...) {
+            stop();
+            throw;
         }
+        cod.close();
+        reader.join();
+        writer.join();
 
         // final callback
         if (cdc_cllbck != nullptr)
             cdc_cllbck->compressCallback(tot_in, tot_out,
-                cdc_strm.stream_size, curr_f_name.c_str());
+                strm_size, curr_f_name.c_str());
 
         // update info
         total_input  += tot_in;
@@ -234,51 +397,155 @@ public:
         return tot_out;
     }
 
-    // decompress file
+    // decompress file, solid one block after block in the same stages as
+    // compression - reader thread reads and decrypts coded blocks, they
+    // are decoded here and writer thread writes and hashes them
     int decompressFile(ifstream &ifile, ofstream &ofile) {
-        int tot_in(0), tot_out(0), cc(0);
-        CodecBuffer *empty_bf, *raw_bf;
+        if (sttgs->byte_chnk_cap) return decompressChunks(ifile);
+        int tot_in(0), tot_out(0), cc(0), used;
+        CodecBuffer *bf, *raw_bf;
+        BoundedQueue<CodecBuffer*> raw(io_bufs), raw_free(io_bufs), cod(io_bufs), cod_free(io_bufs);
+        auto stop = [&]() { raw.close(); raw_free.close(); cod.close(); cod_free.close(); };
+        for (int i = 0; i < io_bufs; i++) {
+            raw_free.push(io_bfs[0] + i);
+            cod_free.push(io_bfs[1] + i);
+        }
 
         // init
-        init();
-        hf_cdc->initStream(&cdc_strm);
-        lz_cdc->initStream(&cdc_strm);
+        ctx->init();
+
+        // read coded blocks
+        StageThread reader([&]() {
+            CodecBuffer *rb;
+            int in(0);
+            while (in < strm_size && cod_free.pop(rb)) {
+                in += readBlock(ifile, rb);
+                cod.push(rb);
+            }
+            cod.close();
+        }, stop);
+
+        // write and hash decoded blocks
+        StageThread writer([&]() {
+            CodecBuffer *wb;
+            while (raw.pop(wb)) {
+                writeAndHash(ofile, (char*)wb->mem, wb->size);
+                raw_free.push(wb);
+            }
+        }, stop);
+
+        try {
+            while (cod.pop(bf)) {
+
+                // decode block and hand it to writer
+                tot_in += bf->size;
+                raw_bf = ctx->decompressBlock(bf->mem, &used);
+                cod_free.push(bf);
+                if (!raw_free.pop(bf)) break;
+                memcpy(bf->mem, raw_bf->mem, raw_bf->size);
+                bf->size = raw_bf->size;
+                raw_bf->type = CBT_EMPTY;
+                raw.push(bf);
+                tot_out += bf->size;
+
+                // callback
+                if (cdc_cllbck != nullptr && !(cc++ % 10))
+                    cdc_cllbck->decompressCallback(tot_in,
+                        tot_out, strm_size, curr_f_name.c_str());
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+        raw.close();
+        reader.join();
+        writer.join();
 
-        while (tot_in < cdc_strm.stream_size) {
+        // final callback
+        if (cdc_cllbck != nullptr)
+            cdc_cllbck->decompressCallback(tot_in, tot_out,
+                strm_size, curr_f_name.c_str());
 
-            // read 4 blocks
-            for (int i = 0; i < ILZSN; i++) {
-                empty_bf = cdc_strm.find(CBT_EMPTY);
+        // update info
+        total_input += tot_in;
+        total_output += tot_out;
+        return tot_in;
+    }
 
-                // read and decrypt block
-                readAndDecrypt(ifile, (char*)&empty_bf->size, sizeof(int));
-                readAndDecrypt(ifile, (char*)empty_bf->mem, empty_bf->size);
-                tot_in     += sizeof(int) + empty_bf->size;
-                empty_bf->type = CBT_HF;
+    // decompress chunked file - index at its end tells where every chunk
+    // starts in archive and in output file, reader hands chunks to workers
+    // which write them in place, hashes are taken in file order
+    int decompressChunks(ifstream &ifile) {
+        int tot_in(0), tot_out(0), cnt(0);
+        QWord base(ifile.tellg()), pos(0);
+        deque<shared_ptr<Chunk>> chunks;
+        vector<ChunkHeader> idx;
+
+        // every worker writes its chunks through one handle of its own
+        wrk_out.resize(wrk_ctx.size());
+        for (auto &f : wrk_out) {
+            if (f.is_open()) f.close();
+            f.clear();
+            f.open(curr_f_path, ios::in | ios::out | ios::binary);
+            if (!f.is_open()) throw string(S_ERR_FOPN);
+        }
 
-                // decompress each block compressed with huffman algorithm
-                hf_cdc->decompressBlock();
+        // read index
+        ifile.seekg(base + strm_size - sizeof(int));
+        ifile.read((char*)&cnt, sizeof(int));
+        if (cnt < 0 || QWord(cnt) * sizeof(ChunkHeader) + sizeof(int) > QWord(strm_size))
+            throw string(S_ERR_FOPN);
+        idx.resize(size_t(cnt));
+        ifile.seekg(base + strm_size - sizeof(int) - cnt * sizeof(ChunkHeader));
+        ifile.read((char*)idx.data(), cnt * sizeof(ChunkHeader));
+        ifile.seekg(base);
+
+        for (int i = 0; i <= cnt; i++) {
+
+            // read chunk and decode it with first free worker, key moves
+            // past it as if it was decrypted here
+            if (i < cnt) {
+                auto c = make_shared<Chunk>();
+                c->in.resize(idx[i].c_cmp_size);
+                c->out.reserve(idx[i].c_dcm_size);
+                ifile.read((char*)c->in.data(), idx[i].c_cmp_size);
+                c->key   = key_pos;
+                c->pos   = pos;
+                key_pos += idx[i].c_cmp_size;
+                tot_in  += idx[i].c_cmp_size;
+                pos     += idx[i].c_dcm_size;
+                c->ready = c->done.get_future();
+                pool->submit([this, c](int w) { decompressChunk(c.get(), w); });
+                chunks.push_back(c);
             }
 
-            // decompress LZ 4 blocks into one
-            lz_cdc->decompressBlock();
-            raw_bf = cdc_strm.find(CBT_RAW);
-
-            // write into file and hash block
-            writeAndHash(ofile, (char*)raw_bf->mem, raw_bf->size);
-            tot_out += raw_bf->size;
-            raw_bf->type = CBT_EMPTY;
+            // take hashes of chunks which are first in order
+            while (chunks.size() >= 2 * size_t(pool->size()) || (i == cnt && !chunks.empty()) ||
+                (!chunks.empty() && chunks.front()->ready.wait_for(chrono::seconds(0)) == future_status::ready)) {
+                chunks.front()->ready.get();
+                updateHash((char*)&chunks.front()->hash, sizeof(DWord));
+                tot_out += int(chunks.front()->out.size());
+                chunks.pop_front();
+                if (cdc_cllbck != nullptr)
+                    cdc_cllbck->decompressCallback(tot_in,
+                        tot_out, strm_size, curr_f_name.c_str());
+            }
+        }
 
-            // callback
-            if (cdc_cllbck != nullptr && !(cc++ % 10))
-                cdc_cllbck->decompressCallback(hf_cdc->getTotalIn(),
-                    lz_cdc->getTotalOut(), cdc_strm.stream_size, curr_f_name.c_str());
+        // every chunk is written, handles are flushed
+        for (auto &f : wrk_out) {
+            f.close();
+            if (f.fail()) throw string(S_ERR_FOPN);
         }
 
+        // skip index
+        ifile.seekg(base + strm_size);
+        tot_in = strm_size;
+
         // final callback
         if (cdc_cllbck != nullptr)
             cdc_cllbck->decompressCallback(tot_in, tot_out,
-                cdc_strm.stream_size, curr_f_name.c_str());
+                strm_size, curr_f_name.c_str());
 
         // update info
         total_input += tot_in;
@@ -287,27 +554,54 @@ public:
     }
 
 private:
-    // write archive header
+    // write archive header with settings used for compression
     void writeHeader(ofstream &ofile, DWord a_fcnt, DWord a_flgs,
         QWord a_unc_size, QWord a_cmp_size) {
         ArchiveHeader ah;
+        memset(&ah, 0, sizeof(ah));
         ah.a_fcnt = a_fcnt; ah.a_flgs = a_flgs; ah.a_sig2 = sig2;
         ah.a_cmp_size = a_cmp_size; ah.a_unc_size = a_unc_size;
         memcpy(ah.a_sig, sig, sizeof(sig));
+        ah.a_ver        = ver;
+        ah.a_level      = sttgs->level;
+        ah.a_blk_cap    = sttgs->bit_blk_cap;
+        ah.a_lkp_cap    = sttgs->bit_lkp_cap;
+        ah.a_lkp_hsh    = sttgs->byte_lkp_hsh;
+        ah.a_mtch_len   = sttgs->bit_mtch_len;
+        ah.a_mtch_pos   = sttgs->bit_mtch_pos;
+        ah.a_bffr_cnt   = sttgs->bit_bffr_cnt;
+        ah.a_runs       = sttgs->bit_runs;
+        ah.a_mtch_fndr  = sttgs->mtch_fndr;
+        ah.a_prs_strtgy = sttgs->prs_strtgy;
+        ah.a_lz_codec   = sttgs->lz_codec;
+        ah.a_chnk_cap   = sttgs->bit_chnk_cap;
         ofile.write((char*)&ah, sizeof(ah));
     }
 
-    // read archive header
+    // read archive header and settings archive was compressed with
     bool readHeader(ifstream &ifile, DWord *a_fcnt, DWord *a_flgs,
-        QWord *a_unc_size, QWord *a_cmp_size) {
+        QWord *a_unc_size, QWord *a_cmp_size, CodecSettings *a_sttgs) {
         ArchiveHeader ah;
+        memset(&ah, 0, sizeof(ah));
         ifile.read((char*)&ah, sizeof(ah));
-        if (ifile.gcount() !=  sizeof(ah)) return false;
         if (memcmp(ah.a_sig, sig, sizeof(sig)) == 0 && ah.a_sig2 == sig2) {
+            if (ah.a_ver != ver) throw string(S_ERR_VER);
+            if (ifile.gcount() != sizeof(ah)) return false;
             if (a_fcnt) *a_fcnt = ah.a_fcnt;
             if (a_flgs) *a_flgs = ah.a_flgs;
             if (a_unc_size) *a_unc_size = ah.a_unc_size;
             if (a_cmp_size) *a_cmp_size = ah.a_cmp_size;
+            if (a_sttgs) {
+                a_sttgs->Set(ah.a_blk_cap, ah.a_lkp_cap, 0, ah.a_mtch_len,
+                    ah.a_mtch_pos, ah.a_bffr_cnt, ah.a_runs);
+                a_sttgs->byte_lkp_hsh = ah.a_lkp_hsh;
+                a_sttgs->mtch_fndr    = MatchFinderType(ah.a_mtch_fndr);
+                a_sttgs->prs_strtgy   = ParseStrategy(ah.a_prs_strtgy);
+                a_sttgs->lz_codec     = CodecType(ah.a_lz_codec);
+                a_sttgs->level        = ah.a_level;
+                a_sttgs->bit_chnk_cap  = ah.a_chnk_cap;
+                a_sttgs->byte_chnk_cap = ah.a_chnk_cap ? 1 << ah.a_chnk_cap : 0;
+            }
             return true;
         } else {
             if (a_fcnt) *a_fcnt         = 0;
@@ -319,18 +613,21 @@ private:
     }
 
 public:
-    // add single file/folder to archive
-    bool archiveAddFile(ofstream &arch, string &f, bool dir = false) {
-        int h_pos, e_pos;
-        ifstream ifile;
-        FileHeader fh;
+    // fill header with info about file
+    void fillHeader(FileHeader &fh, string &f, bool dir) {
         memset(&fh, 0, sizeof(FileHeader));
-        
-        // fill header with info about file
         if (dir) fh.f_flags = FF_DIR;
         fh.f_nm_cnt = DWord(f.length());
         fh.f_attr = getFileAttributes(f.c_str());
         getFileTime(f.c_str(), &fh.f_cr_time, &fh.f_la_time, &fh.f_lw_time, dir);
+    }
+
+    // add single file/folder to archive
+    bool archiveAddFile(ofstream &arch, string &f, bool dir = false) {
+        int h_pos, e_pos;
+        ifstream ifile;
+        FileHeader fh;
+        fillHeader(fh, f, dir);
 
         // remember header position and write header
         h_pos = int(arch.tellp());
@@ -344,7 +641,7 @@ public:
             ifile.open(f, ios::binary); if (!ifile.is_open()) return false;
 
             // update file header
-            cdc_strm.stream_size = fh.f_dcm_size = DWord(file_size(f));
+            strm_size = fh.f_dcm_size = DWord(file_size(f));
             curr_f_name = path(f).filename().string();
             cdc_cllbck->init(); initHash();
 
@@ -366,12 +663,169 @@ public:
         return true;
     }
 
+    // write files of chunked archive in order as far as their chunks are
+    // coded, file is started when its first chunk is ready
+    void writeFiles(ofstream &arch, deque<shared_ptr<FileJob>> &files) {
+        while (!files.empty()) {
+            FileJob *fj = files.front().get();
+            FileHeader &fh = fj->fh;
+            int cnt;
+
+            // header and name, final one if all chunks are ready
+            if (!fj->started) {
+                if (!fj->chunks.empty() && !isReady(fj->chunks.front().get())) return;
+                fj->whole = fj->read;
+                for (auto &c : fj->chunks) fj->whole = fj->whole && isReady(c.get());
+                curr_f_name = path(fj->name).filename().string();
+                strm_size   = fh.f_dcm_size;
+                cdc_cllbck->init(); initHash();
+                if (fj->whole && !(fh.f_flags & FF_DIR)) {
+                    fh.f_cmp_size = DWord(fj->chunks.size() * sizeof(ChunkHeader) + sizeof(int));
+                    for (auto &c : fj->chunks) {
+                        updateHash((char*)&c->hash, sizeof(DWord));
+                        fh.f_cmp_size += DWord(c->out.size());
+                    }
+                    fh.f_cnt_hsh = f_hash;
+                }
+                fj->h_pos = QWord(arch.tellp());
+                arch.write((char*)&fh, sizeof(FileHeader));
+                arch.write((char*)fj->name.c_str(), fh.f_nm_cnt);
+                fj->started = true;
+            }
+
+            // chunks which are ready
+            while (!fj->chunks.empty() && isReady(fj->chunks.front().get())) {
+                Chunk *c = fj->chunks.front().get();
+                if (!fj->whole) updateHash((char*)&c->hash, sizeof(DWord));
+                fj->tot_out += writeChunk(arch, c, fj->idx);
+                fj->tot_in  += int(c->in.size());
+                pend_in     -= c->in.capacity();
+                fj->chunks.pop_front();
+                cdc_cllbck->compressCallback(fj->tot_in, fj->tot_out,
+                    strm_size, curr_f_name.c_str());
+            }
+            if (!fj->read || !fj->chunks.empty()) return;
+
+            // index of chunks, header is rewritten if it wasn't final
+            if (!(fh.f_flags & FF_DIR)) {
+                cnt = int(fj->idx.size());
+                arch.write((char*)fj->idx.data(), cnt * sizeof(ChunkHeader));
+                arch.write((char*)&cnt, sizeof(int));
+                if (!fj->whole) {
+                    QWord e_pos = QWord(arch.tellp());
+                    fh.f_cmp_size = DWord(fj->tot_out + cnt * sizeof(ChunkHeader) + sizeof(int));
+                    fh.f_cnt_hsh  = f_hash;
+                    arch.seekp(fj->h_pos);
+                    arch.write((char*)&fh, sizeof(FileHeader));
+                    arch.seekp(e_pos);
+                }
+                cdc_cllbck->compressCallback(fh.f_dcm_size, fh.f_cmp_size,
+                    strm_size, curr_f_name.c_str());
+                consoleEndLine();
+                total_input  += fh.f_dcm_size;
+                total_output += fh.f_cmp_size;
+            }
+            files.pop_front();
+        }
+    }
+
+    // wait for oldest chunk which isn't written yet
+    void waitFiles(deque<shared_ptr<FileJob>> &files) {
+        if (!files.empty() && !files.front()->chunks.empty())
+            files.front()->chunks.front()->ready.wait();
+    }
+
+    // add files to chunked archive in three stages - reader thread reads
+    // files in archive order and hands their chunks to workers as soon as
+    // they are read, so small files are coded side by side and big ones in
+    // chunks at once; writer here takes files and chunks from reader in the
+    // same order and writes them when they are coded, it stops taking them
+    // when chunks which aren't written hold two chunks per worker of raw
+    // data, then reader waits too
+    bool archiveAddChunked(ofstream &arch, vector<pair<string, bool>> &items) {
+        deque<shared_ptr<FileJob>> files;
+        pair<shared_ptr<FileJob>, shared_ptr<Chunk>> itm;
+        BoundedQueue<pair<shared_ptr<FileJob>, shared_ptr<Chunk>>> read(pool->size());
+        QWord limit = 2 * QWord(pool->size()) * sttgs->byte_chnk_cap;
+        bool ok(true), more(true);
+        pend_in = 0;
+
+        // reader sends file when it's opened, then its chunks and empty
+        // pair when it's read
+        StageThread reader([&]() {
+            for (auto &it : items) {
+                auto fj = make_shared<FileJob>();
+                ifstream ifile;
+                QWord    left(0);
+                fj->name = it.first;
+                fj->read = fj->started = fj->whole = false;
+                fj->tot_in = fj->tot_out = 0;
+                fj->h_pos = 0;
+                fillHeader(fj->fh, fj->name, it.second);
+                if (!it.second) {
+                    ifile.open(fj->name, ios::binary);
+                    if (!ifile.is_open()) { ok = false; break; }
+                    left = file_size(fj->name);
+                    fj->fh.f_dcm_size = DWord(left);
+                }
+                if (!read.push(make_pair(fj, nullptr))) return;
+
+                // chunk buffer is as big as rest of file, so small files
+                // don't hold whole chunk each
+                while (left > 0 && ifile.good()) {
+                    auto c = make_shared<Chunk>();
+                    c->in.resize(size_t(left < sttgs->byte_chnk_cap ? left : sttgs->byte_chnk_cap));
+                    ifile.read((char*)c->in.data(), int(c->in.size()));
+                    if (size_t(ifile.gcount()) < c->in.size()) {
+                        c->in.resize(size_t(ifile.gcount()));
+                        c->in.shrink_to_fit();
+                    }
+                    if (c->in.empty()) break;
+                    left -= c->in.size();
+                    c->ready = c->done.get_future();
+                    pool->submit([this, c](int w) { compressChunk(c.get(), wrk_ctx[w]); });
+                    if (!read.push(make_pair(nullptr, c))) return;
+                }
+                if (!read.push(make_pair(nullptr, nullptr))) return;
+            }
+            read.close();
+        }, [&]() { read.close(); });
+
+        try {
+            while (more || !files.empty()) {
+                writeFiles(arch, files);
+
+                // take next file or chunk from reader unless too much waits
+                if (more && pend_in <= limit) {
+                    if (!(more = read.pop(itm))) {
+                        reader.join();
+                    } else if (itm.first) {
+                        files.push_back(itm.first);
+                    } else if (itm.second) {
+                        files.back()->chunks.push_back(itm.second);
+                        pend_in += itm.second->in.capacity();
+                    } else {
+                        files.back()->read = true;
+                    }
+                    continue;
+                }
+                waitFiles(files);
+            }
+        } catch (...) {
+            read.close();
+            throw;
+        }
+        reader.join();
+        return ok;
+    }
+
     // create archive from directory or file
     bool archiveCreate(string &dir_name, string &arch_name) {
         DWord f_cnt(0), f_flgs(0);
         int b_pos(0);
         ofstream arch;
         path dir(dir_name);
+        vector<pair<string, bool>> items;
 
         // ask for password
         consoleAskPassword1(e_key);
@@ -388,45 +842,37 @@ public:
         if (!e_key.empty()) f_flgs |= AF_ENCRYPT;
         writeHeader(arch, f_cnt, f_flgs, 0, 0);
         initEncryption(!e_key.empty(), nullptr, &arch);
+        configure(true);
         
         // directory
         if (is_directory(dir)) {
             dir = dir.filename();
 
-            // add every file and folder in directory
+            // every file and folder in directory
             for (auto& itm : recursive_directory_iterator(dir)) {
                 string f = ((string)((path)itm).string());
-
-                // file
-                if (is_regular_file(f)) {
-                    if (!archiveAddFile(arch, f))  return false;
-                    f_cnt++;
-
-                // directory
-                } else if (is_directory(f)) {
-                    if (!archiveAddFile(arch, f, true))
-                        return false;
-                    f_cnt++;
-                }
-            }
-
-            if (f_cnt == 0) {
-                string f(dir.string());
-                if (!archiveAddFile(arch, f, true))
-                    return false;
-                f_cnt++;
+                if (is_regular_file(f))  items.emplace_back(f, false);
+                else if (is_directory(f)) items.emplace_back(f, true);
             }
+            if (items.empty()) items.emplace_back(dir.string(), true);
 
         // file
         } else if(is_regular_file(dir)) {
 
             // just add one file to archive
-            string f = (string)(dir.filename().string());
-            if (!archiveAddFile(arch, f))
-                return false;
-            f_cnt = 1;
+            items.emplace_back(dir.filename().string(), false);
         } else { return false; }
 
+        // chunked files are coded by workers across files, solid ones one
+        // after another
+        if (sttgs->byte_chnk_cap) {
+            if (!archiveAddChunked(arch, items)) return false;
+        } else {
+            for (auto &itm : items)
+                if (!archiveAddFile(arch, itm.first, itm.second)) return false;
+        }
+        f_cnt = DWord(items.size());
+
         // go back and write archive header again
         arch.seekp(b_pos);
         writeHeader(arch, f_cnt, f_flgs, total_input, total_output);
@@ -445,7 +891,8 @@ public:
 
         // read header
         arch.open(arch_name, ios::binary); if (!arch.is_open()) return false;
-        if (!readHeader(arch, &a_cnt, &a_flags, &a_unc_size, &a_cmp_size)) return false;
+        if (!readHeader(arch, &a_cnt, &a_flags, &a_unc_size, &a_cmp_size, sttgs)) return false;
+        configure(!list);
 
         // ask for password if archive is encrypted
         if (a_flags & AF_ENCRYPT) consoleAskPassword2(e_key);
@@ -507,9 +954,10 @@ public:
                 if (!(fh.f_flags & FF_DIR)) {
                     ofstream ofile;
                     ofile.open(p, ios::binary);
-                    cdc_strm.stream_size = fh.f_cmp_size;
+                    strm_size = fh.f_cmp_size;
                     cdc_cllbck->init(); initHash();
                     curr_f_name = p.filename().string();
+                    curr_f_path = p.string();
 
                     // try {} catch() for wrong password exception
                     try {
@@ -575,7 +1023,7 @@ public:
             ifstream ifile(name, ios::binary);
             bool is_arch = ifile.is_open();
             if (is_arch)
-                is_arch = readHeader(ifile, nullptr, nullptr, nullptr, nullptr);
+                is_arch = readHeader(ifile, nullptr, nullptr, nullptr, nullptr, nullptr);
             ifile.close();
             if (is_arch) {
                 // input is archove
@@ -641,20 +1089,34 @@ public:
         setConsoleTextNormal();
         consoleWriteEndLine(S_INF2);
 
-        // app takes only 1 argument
+        // app takes file name and list option or compression level
+        // optionally followed by ROLZ, high ratio and multithreaded or
+        // parallel search options, the last one may be followed by number
+        // of threads
         if (argc > 1) {
             CodecSettings        sttgs;
-            sttgs.Set(16, 16, 2, 8, 16, 3, 2);
-            sttgs.byte_lkp_hsh = 5;
             LZHX                 lzhx(&sttgs);
-            LZ                   lz  (&sttgs);
-            Huffman              huffman;
             ConsoleCodecCallback callback;
-            lzhx.setCodec   (&huffman);
-            lzhx.setCodec   (&lz);
+            bool list  = false, rolz = false, cm = false, mt = false, ps = false;
+            int  thrds = argc > 3 ? atoi(argv[3]) : 0;
+            int  level = CL_DEF;
+            if (argc > 2) {
+                for (char const *c = argv[2]; *c; c++) {
+                    if (*c == S_LISTC1 || *c == S_LISTC2) list = true;
+                    if (*c == S_ROLZC1 || *c == S_ROLZC2) rolz = true;
+                    if (*c == S_CMC1   || *c == S_CMC2)   cm   = true;
+                    if (*c == S_MTC1   || *c == S_MTC2)   mt   = true;
+                    if (*c == S_PSC1   || *c == S_PSC2)   ps   = true;
+                    if (*c >= '0' + CL_MIN && *c <= '0' + CL_MAX) level = *c - '0';
+                }
+            }
+            sttgs.SetLevel(level);
+            if (rolz) sttgs.lz_codec = CT_ROLZ;
+            if (cm)   sttgs.ent_codec |= CT_CM;
+            if (mt)   sttgs.SetChunked();
+            else if (ps && !rolz) sttgs.SetParallelSearch(thrds > 0 ? thrds : defaultThreads());
+            lzhx.setThreads(thrds);
             lzhx.setCallback(&callback);
-            bool list = false;
-            if (argc > 2) list = (bool)(argv[2][0] == S_LISTC1 || argv[2][0] == S_LISTC2);
             lzhx.detectInput(string(argv[1]), list);
         } else {
             // print usage info
@@ -0,0 +1,348 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+// c++
+#include <cstring>
+
+// LZHX
+#include "ROLZ.h"
+#include "Utils.h"
+
+using namespace LZHX;
+
+// reduced offset match finder, search depth follows level
+ROLZMatchFinder::ROLZMatchFinder(CodecSettings *cdc_sttgs) : LZMatchFinder(cdc_sttgs) {
+    this->tbl      = new DWord[IRZCTX * IRZSLT];
+    this->tbl_head = new DWord[IRZCTX];
+    this->depth    = cdc_sttgs->byte_runs * 8 < IRZSLT ? cdc_sttgs->byte_runs * 8 : IRZSLT;
+    clear();
+}
+ROLZMatchFinder::~ROLZMatchFinder() {
+    delete[] this->tbl;
+    delete[] this->tbl_head;
+}
+void ROLZMatchFinder::clear() {
+    memset(tbl, 0, sizeof(DWord) * IRZCTX * IRZSLT);
+    memset(tbl_head, 0, sizeof(DWord) * IRZCTX);
+}
+
+// context of position is 2 bytes before it, previous one in low byte,
+// missing ones at stream start are 0
+Word ROLZMatchFinder::context(int pos) {
+    Word ctx(0);
+    if (blk_base - blk_floor + pos >= 2) ctx = Word(streamByte(2, pos, 0) << 8);
+    if (blk_base - blk_floor + pos >= 1) ctx |= streamByte(1, pos, 0);
+    return ctx;
+}
+
+// ring of context, 2 bytes are hashed into fewer rings
+DWord ROLZMatchFinder::ring(Word ctx) {
+    return (DWord(ctx) * 2654435761u) >> (32 - IRZCTXB);
+}
+
+// remember absolute position in context ring, slot 0 is the newest one,
+// slot left from stream before reset is empty
+void ROLZMatchFinder::put(Word ctx, DWord abs_pos) {
+    DWord r = ring(ctx);
+    tbl[r * IRZSLT + (tbl_head[r]++ & (IRZSLT - 1))] = abs_pos + 1;
+}
+DWord ROLZMatchFinder::get(Word ctx, int slot) {
+    DWord r = ring(ctx), cand;
+    cand = tbl[r * IRZSLT + ((tbl_head[r] - 1 - DWord(slot)) & (IRZSLT - 1))];
+    return cand > blk_floor ? cand : 0;
+}
+
+// insert new item into dictionary
+void ROLZMatchFinder::insert(int pos) { put(context(pos), blk_base + pos); }
+
+// find longest match among slots of current context, match pos is slot
+int ROLZMatchFinder::findAll(int pos) {
+    int   max_len, len, best(0), cnt(0);
+    DWord abs_pos, cand, dist;
+    Word  ctx;
+    Byte *cur;
+    if ((max_len = maxLen(pos)) == 0) return 0;
+    abs_pos = blk_base + pos;
+    cur     = buf + pos;
+    ctx     = context(pos);
+    for (int k = 0; k < depth; k++) {
+
+        // slots are ordered by age, so first one out of window ends search
+        if ((cand = get(ctx, k)) == 0) break;
+        dist = abs_pos - (cand - 1);
+        if (dist > cdc_sttgs->mask_mtch_pos) break;
+
+        // quick reject on byte which would make match better
+        if (streamByte(dist, pos, best) != cur[best]) continue;
+
+        len = streamLen(dist, pos, 0, max_len);
+        if (best < len) {
+            best = matches[0].len = len;
+            matches[0].pos = k;
+            cnt = 1;
+            if (len >= max_len) break;
+        }
+    }
+    return cnt;
+}
+
+// rolz main class
+ROLZ::ROLZ(CodecSettings *cdc_sttgs) : len_bkt(ILZLENDIR), slot_bkt(IRZSLTDIR) {
+    bit_stream = new BitStream;
+    rz_mf   = new ROLZMatchFinder(cdc_sttgs);
+    lz_buf  = new LZDictionaryBuffer(cdc_sttgs->byte_mtch_pos, cdc_sttgs->byte_mtch_len);
+    abs_pos = 0;
+    last    = 0;
+    this->cdc_sttgs = cdc_sttgs;
+}
+ROLZ::~ROLZ() {
+    if (bit_stream) delete bit_stream;
+    if (rz_mf)  delete rz_mf;
+    if (lz_buf) delete lz_buf;
+}
+
+// info
+CodecType ROLZ::getCodecType() { return CT_ROLZ; }
+int ROLZ::getTotalIn()  { return total_in;  }
+int ROLZ::getTotalOut() { return total_out; }
+
+// init
+void ROLZ::initStream(CodecStream *cs) {
+    this->codec_stream = cs;
+    this->total_in     = 0;
+    this->total_out    = 0;
+}
+
+// new stream in place, context slots are hidden by finder and stream
+// position goes on unless finder was rebased
+void ROLZ::reset() {
+    if (rz_mf->reset()) {
+        lz_buf->rewind();
+        abs_pos = 0;
+    }
+    last = 0;
+}
+
+// add n bytes into context slots, dictionary gets whole block at its end
+void ROLZ::advance(int &i, int n) {
+    while (n--) rz_mf->insert(i++);
+}
+
+// search for longest match at i
+void ROLZ::findMatch(int i, LZMatch *m) {
+    m->clear();
+    if (rz_mf->findAll(i) && rz_mf->getMatches()->len >= IRZMINML)
+        m->copy(rz_mf->getMatches());
+}
+
+// write literal to stream
+void ROLZ::writeLiteral(Byte b) {
+    if (b >= IRZICN) {
+        out_bf[ILZIS][out_i[ILZIS]++] = b;
+    } else {
+        out_bf[ILZIS][out_i[ILZIS]++] = (Byte)(IRZIL);
+        out_bf[ILZLS][out_i[ILZLS]++] = b;
+    }
+}
+
+// write match to stream, slot and length are buckets with extra bits
+// like position and length in LZ
+void ROLZ::writeMatch(LZMatch *m) {
+    DWord s = DWord(m->pos), v = DWord(m->len - IRZMINML);
+    int   sb = slot_bkt.bucket(s), b = len_bkt.bucket(v);
+    out_bf[ILZIS] [out_i[ILZIS] ++] = (Byte)(IRZIM);
+    out_bf[ILZMPS][out_i[ILZMPS]++] = (Byte)(sb);
+    out_bf[ILZMLS][out_i[ILZMLS]++] = (Byte)(b);
+    bit_stream->writeBits(s - slot_bkt.base[sb], slot_bkt.bits[sb]);
+    bit_stream->writeBits(v - len_bkt.base[b], len_bkt.bits[b]);
+}
+
+// take longest match at each position
+void ROLZ::parseGreedy() {
+    LZMatch m;
+    int i(0);
+    while (i < in_size) {
+        findMatch(i, &m);
+        if (m.len) {
+            writeMatch(&m);
+            advance(i, m.len);
+        } else {
+            writeLiteral(in_bf[i]);
+            advance(i, 1);
+        }
+    }
+}
+
+// before writing match check if next position gives longer one, if so
+// write literal instead and try again from there
+void ROLZ::parseLazy() {
+    LZMatch m, next;
+    int i(0);
+    if (in_size > 0) findMatch(i, &m);
+    while (i < in_size) {
+        if (m.len) {
+            advance(i, 1);
+            next.clear();
+            if (m.len < ILZNICEML && i < in_size) findMatch(i, &next);
+            if (next.len > m.len) {
+                writeLiteral(in_bf[i - 1]);
+                m.copy(&next);
+                continue;
+            }
+            writeMatch(&m);
+            advance(i, m.len - 1);
+        } else {
+            writeLiteral(in_bf[i]);
+            advance(i, 1);
+        }
+        if (i < in_size) findMatch(i, &m);
+    }
+}
+
+// compress block
+int ROLZ::compressBlock() {
+    int out_size(0);
+    CodecBuffer *cb_in, *cb_out[ILZSN];
+
+    // find raw buffer to compress
+    cb_in = codec_stream->find(CBT_RAW);
+    in_bf = cb_in->mem;
+
+    // find empty buffers for output
+    // 0 -> instructions; 1 -> slot; 2 -> len; 3 ->literal; 4 -> extra bits;
+    for (int j = 0; j < ILZSN; j++) {
+        out_i [j]       = 0;
+        cb_out[j]       = codec_stream->find(CBT_EMPTY);
+        cb_out[j]->type = CBT_LZ;
+        out_bf[j]       = cb_out[j]->mem;
+
+        // first byte of buffer is buffer type
+        out_bf[j][out_i[j]++] = Byte(j);
+    }
+
+    // input stream after compression will be empty
+    cb_in->type = CBT_EMPTY;
+    in_size     = cb_in->size;
+
+    // assign buffer to match finder, write input size into extra bits
+    rz_mf->assignBuffer(in_bf, in_size, lz_buf);
+    bit_stream->assignBuffer(out_bf[ILZXS] + out_i[ILZXS], cb_out[ILZXS]->cap - out_i[ILZXS]);
+    bit_stream->writeBits(in_size, 32);
+
+    // split block into literals and matches, optimal parsing needs
+    // prices of slots and is left to LZ
+    if (cdc_sttgs->prs_strtgy == PS_GREEDY) parseGreedy();
+    else                                    parseLazy();
+    lz_buf->putBlock(in_bf, in_size);
+    bit_stream->flush();
+    out_i[ILZXS] += bit_stream->getBytePos();
+    abs_pos += in_size;
+    for (int j = in_size > 2 ? in_size - 2 : 0; j < in_size; j++)
+        last = Word(last << 8 | in_bf[j]);
+
+    // set output buffer sizes
+    for (int j = 0; j < ILZSN; j++) {
+        out_size       += out_i[j];
+        cb_out[j]->size = out_i[j];
+    }
+
+    // update processed bytes length
+    total_in  += in_size;
+    total_out += out_size;
+    return out_size;
+}
+
+// decompress block, every decoded byte goes to its context slots the
+// same way encoder inserted it
+int ROLZ::decompressBlock() {
+    int i[ILZSN], dec_size(0), in_len[ILZSN], len, o(0), b;
+    CodecBuffer *cb_out, *cb_in[ILZSN];
+    Byte *out, *temp_in[ILZSN], *in[ILZSN], c;
+    DWord cand, dist;
+    BitStream xs;
+
+    // find empty buffer for output
+    cb_out = codec_stream->find(CBT_EMPTY);
+    out = cb_out->mem;
+
+    // find lz input buffers
+    for (int j = 0; j < ILZSN; j++) {
+        cb_in  [j]       = codec_stream->find(CBT_LZ);
+        cb_in  [j]->type = CBT_EMPTY;
+        temp_in[j]       = cb_in[j]->mem;
+        in     [j]       = nullptr;
+        i      [j]       = 1;
+    }
+
+    // output will be raw data
+    cb_out->type = CBT_RAW;
+
+    // sort buffers by their function
+    // 0 -> instructions; 1 -> slot; 2 -> len; 3 ->literal; 4 -> extra bits;
+    for (int k = 0; k < ILZSN; k++)
+        for (int j = 0; j < ILZSN; j++)
+            if (temp_in[k][0] == j) {
+                in    [j] = temp_in[k];
+                in_len[j] = cb_in[k]->size;
+            }
+
+    // read uncompressed size
+    xs.assignBuffer(in[ILZXS] + i[ILZXS], in_len[ILZXS] - i[ILZXS]);
+    dec_size = xs.readBits(32);
+
+    // finder follows stream position like in encoder, so reset knows it
+    rz_mf->assignBuffer(out, dec_size, lz_buf);
+
+    while (o < dec_size) {
+        c = in[ILZIS][i[ILZIS]++];
+
+        if (c == IRZIM) {
+            // read match, slot of current context tells its position
+            b    = in[ILZMPS][i[ILZMPS]++];
+            cand = rz_mf->get(last, int(slot_bkt.base[b] + xs.readBits(slot_bkt.bits[b])));
+            dist = cand ? abs_pos - (cand - 1) : 1;
+            b    = in[ILZMLS][i[ILZMLS]++];
+            len  = int(len_bkt.base[b] + xs.readBits(len_bkt.bits[b])) + IRZMINML;
+
+            // copy match, damaged stream can't write past the block
+            if (DWord(len) > DWord(dec_size - o)) len = dec_size - o;
+            lz_buf->copyMatch(out, o, int(dist), len);
+            for (int j = 0; j < len; j++) {
+                rz_mf->put(last, abs_pos++);
+                last = Word(last << 8 | out[o++]);
+            }
+        } else {
+            // literal, inline or escaped one
+            rz_mf->put(last, abs_pos++);
+            out[o] = (c == IRZIL) ? in[ILZLS][i[ILZLS]++] : c;
+            last = Word(last << 8 | out[o++]);
+        }
+    }
+
+    // insert processed bytes into dictionary
+    lz_buf->putBlock(out, dec_size);
+
+    // update info
+    i[ILZXS] += xs.getBytePos();
+    for (int j = 0; j < ILZSN; j++) {
+        total_in += i[j];
+    }
+
+    total_out   += dec_size;
+    cb_out->size = dec_size;
+    return dec_size;
+}
+
+// block skipped by ROLZ still goes to context slots, all its positions
+// are inserted like in coded block
+void ROLZ::passBlock(Byte *buf, int size) {
+    rz_mf->assignBuffer(buf, size, lz_buf);
+    for (int j = 0; j < size; j++) {
+        rz_mf->put(last, abs_pos++);
+        last = Word(last << 8 | buf[j]);
+    }
+    lz_buf->putBlock(buf, size);
+}
@@ -0,0 +1,85 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+#ifndef LZHX_ROLZ_H
+#define LZHX_ROLZ_H
+
+// LZHX
+#include "Types.h"
+#include "LZ.h"
+
+// ROLZ instructions, streams are the same as in LZ
+#define IRZIM  0 // match, slot number follows in match pos stream
+#define IRZIL  1 // literal
+#define IRZICN 2 // instruction count, literals below it are escaped
+
+// others
+#define IRZCTXB   14             // bits of context rings - hash of previous 2 bytes
+#define IRZCTX    (1 << IRZCTXB) // context rings
+#define IRZSLTB   8              // bits of candidate slots per context
+#define IRZSLT    (1 << IRZSLTB) // candidate slots per context
+#define IRZSLTDIR 4              // direct bits of slot
+#define IRZMINML  3              // minimum match len
+
+namespace LZHX {
+
+// reduced offset match finder - every context of 2 previous bytes keeps
+// ring of last IRZSLT positions which followed it, match position is
+// slot number counted from the most recent one
+class ROLZMatchFinder : public LZMatchFinder {
+private:
+    DWord *tbl;
+    DWord *tbl_head;
+    int    depth;
+    Word   context(int pos);
+    DWord  ring(Word ctx);
+    void   clear();
+public:
+    ROLZMatchFinder(CodecSettings *cdc_sttgs);
+    ~ROLZMatchFinder();
+    void  put(Word ctx, DWord abs_pos);
+    DWord get(Word ctx, int slot);
+    void  insert (int pos);
+    int   findAll(int pos);
+};
+
+// reduced offset lz main class
+class ROLZ : public CodecInterface {
+private:
+    int total_in, total_out;
+    CodecStream        *codec_stream;
+    CodecSettings      *cdc_sttgs;
+    BitStream          *bit_stream;
+    ROLZMatchFinder    *rz_mf;
+    LZDictionaryBuffer *lz_buf;
+    LZBuckets           len_bkt, slot_bkt;
+    // compression state
+    int   in_size, out_i[ILZSN];
+    Byte *in_bf, *out_bf[ILZSN];
+    DWord abs_pos;
+    Word  last;
+    void advance(int &i, int n);
+    void findMatch(int i, LZMatch *m);
+    void writeLiteral(Byte b);
+    void writeMatch(LZMatch *m);
+    void parseGreedy();
+    void parseLazy();
+public:
+    ROLZ(CodecSettings *cdc_sttgs);
+    ~ROLZ();
+    CodecType getCodecType();
+    int  getTotalIn();
+    int  getTotalOut();
+    void initStream(CodecStream *codec_stream);
+    int  compressBlock();
+    int  decompressBlock();
+    void passBlock(Byte *buf, int size);
+    void reset();
+};
+
+} // namespace
+
+#endif // LZHX_ROLZ_H
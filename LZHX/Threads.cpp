@@ -0,0 +1,112 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+// LZHX
+#include "Threads.h"
+
+using namespace LZHX;
+
+// start workers, at least one
+ThreadPool::ThreadPool(int count) {
+    stop       = false;
+    pending    = 0;
+    unfinished = 0;
+    next       = 0;
+    if (count < 1) count = 1;
+    thr_cnt    = count;
+    for (int i = 0; i < count; i++)
+        queues.emplace_back(new TaskQueue);
+    for (int i = 0; i < count; i++)
+        workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+// tasks already submitted are finished before workers end
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers) w.join();
+}
+
+// count is set before first worker starts, workers vector still grows
+// while first workers run, so it isn't read
+int ThreadPool::size() { return thr_cnt; }
+
+// put task into queue of next worker, pending count is raised after it
+// is queued, so worker woken by it always finds some task
+void ThreadPool::submit(std::function<void(int)> task) {
+    TaskQueue *q = queues[next].get();
+    next = (next + 1) % size();
+    {
+        std::lock_guard<std::mutex> lock(q->mtx);
+        q->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        pending++;
+        unfinished++;
+    }
+    cv.notify_one();
+}
+
+// wait until every task submitted so far is done, then throw exception
+// of failed one; pool is ready for new tasks after it
+void ThreadPool::wait() {
+    std::exception_ptr e;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        idle.wait(lock, [this] { return unfinished == 0; });
+        e   = err;
+        err = nullptr;
+    }
+    if (e) std::rethrow_exception(e);
+}
+
+// take task from own queue or steal one, queues are tried in the same
+// order from every worker's own one
+bool ThreadPool::take(int id, std::function<void(int)> &task) {
+    for (int k = 0; k < size(); k++) {
+        TaskQueue *q = queues[(id + k) % size()].get();
+        {
+            std::lock_guard<std::mutex> lock(q->mtx);
+            if (q->tasks.empty()) continue;
+            task = std::move(q->tasks.front());
+            q->tasks.pop_front();
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        pending--;
+        return true;
+    }
+    return false;
+}
+
+// worker loop - take task and run it, wait while there is none, end
+// when pool is stopped and every task is done; exception of task is kept
+// for wait(), it can't leave the worker
+void ThreadPool::run(int id) {
+    std::function<void(int)> task;
+    std::exception_ptr       e;
+    for (;;) {
+        if (take(id, task)) {
+            try { task(id); } catch (...) { e = std::current_exception(); }
+            std::lock_guard<std::mutex> lock(mtx);
+            if (e && !err) err = e;
+            e = nullptr;
+            if (--unfinished == 0) idle.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return stop || pending > 0; });
+        if (stop && pending == 0) return;
+    }
+}
+
+int LZHX::defaultThreads() {
+    int n = int(std::thread::hardware_concurrency());
+    return n > 0 ? n : 1;
+}
@@ -0,0 +1,113 @@
+/////////////////////////////////////////
+// Lempel-Ziv-Huffman File Compressor  //
+// author: mariusz.ziach@gmail.com     //
+// date  : 2018                        //
+/////////////////////////////////////////
+
+#ifndef LZHX_THREADS_H
+#define LZHX_THREADS_H
+
+// stl
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <vector>
+
+namespace LZHX {
+
+// fixed number of worker threads, each with its own queue of tasks;
+// tasks are dealt to queues in turns and worker which runs out of them
+// steals oldest task of another one, so short and long tasks even out;
+// task gets index of worker which runs it, so it can use data owned by
+// that worker; tasks are submitted by one thread, which may wait for
+// all of them; first exception thrown by task is thrown again by wait()
+class ThreadPool {
+private:
+    struct TaskQueue {
+        std::deque<std::function<void(int)>> tasks;
+        std::mutex                           mtx;
+    };
+    std::vector<std::thread>                 workers;
+    std::vector<std::unique_ptr<TaskQueue>>  queues;
+    std::mutex                               mtx;
+    std::condition_variable                  cv, idle;
+    std::exception_ptr                       err;
+    int                                      pending, unfinished, next, thr_cnt;
+    bool                                     stop;
+    bool take(int id, std::function<void(int)> &task);
+    void run(int id);
+public:
+    ThreadPool(int count);
+    ~ThreadPool();
+    int  size();
+    void submit(std::function<void(int)> task);
+    void wait();
+};
+
+// queue of at most cap items between two pipeline stages, push waits
+// while it's full and pop while it's empty; closed queue still gives out
+// its items, then pop fails, push fails at once
+template <class T> class BoundedQueue {
+private:
+    std::deque<T>           items;
+    std::mutex              mtx;
+    std::condition_variable not_full, not_empty;
+    size_t                  cap;
+    bool                    closed;
+public:
+    BoundedQueue(size_t cap) : cap(cap), closed(false) {}
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this] { return closed || items.size() < cap; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+    void close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+};
+
+// thread of pipeline stage, exception which ends it is thrown again by
+// join(); onError runs in the stage thread, so other stages can be
+// stopped before it ends
+class StageThread {
+private:
+    std::exception_ptr err;
+    std::thread        thr;
+public:
+    template <class F, class E> StageThread(F body, E onError) {
+        thr = std::thread([this, body, onError]() {
+            try { body(); } catch (...) { err = std::current_exception(); onError(); }
+        });
+    }
+    ~StageThread() { if (thr.joinable()) thr.join(); }
+    void join() {
+        if (thr.joinable()) thr.join();
+        if (err) std::rethrow_exception(err);
+    }
+};
+
+// number of threads used when it isn't given, one per core
+int defaultThreads();
+
+} // namespace
+
+#endif // LZHX_THREADS_H
@@ -18,6 +18,60 @@ CodecBuffer *CodecStream::find(CodecBufferType type) {
     return nullptr;
 }
 
+// compression level presets
+struct CodecLevelPreset {
+    DWord bit_blk_cap, bit_lkp_cap, byte_lkp_hsh, bit_mtch_pos, bit_runs;
+    MatchFinderType mtch_fndr;
+    ParseStrategy   prs_strtgy;
+};
+static const CodecLevelPreset lvl_presets[CL_MAX] = {
+    // blk  lkp  hsh  win  runs  finder  parser
+    {  16,  14,  6,   16,  0,    MFT_HC, PS_GREEDY  }, // 1
+    {  16,  15,  5,   17,  1,    MFT_HC, PS_GREEDY  }, // 2
+    {  16,  16,  5,   18,  2,    MFT_HC, PS_GREEDY  }, // 3
+    {  16,  17,  5,   20,  3,    MFT_HC, PS_LAZY    }, // 4
+    {  17,  18,  4,   21,  4,    MFT_HC, PS_LAZY    }, // 5
+    {  17,  19,  4,   22,  5,    MFT_HC, PS_LAZY    }, // 6
+    {  17,  20,  4,   23,  5,    MFT_BT, PS_LAZY    }, // 7
+    {  18,  21,  4,   24,  6,    MFT_BT, PS_OPTIMAL }, // 8
+    {  18,  22,  4,   26,  7,    MFT_BT, PS_OPTIMAL }, // 9
+};
+
+// set one of compression level presets, window grows from 64 KB at level 1
+// to 64 MB at level 9 and decoder needs the same amount of memory, match
+// can be as long as whole block
+void CodecSettings::SetLevel(DWord lvl) {
+    if (lvl < CL_MIN) lvl = CL_MIN;
+    if (lvl > CL_MAX) lvl = CL_MAX;
+    const CodecLevelPreset &p = lvl_presets[lvl - CL_MIN];
+    Set(p.bit_blk_cap, p.bit_lkp_cap, 0, p.bit_blk_cap, p.bit_mtch_pos, 3, p.bit_runs);
+    byte_lkp_hsh = p.byte_lkp_hsh;
+    mtch_fndr    = p.mtch_fndr;
+    prs_strtgy   = p.prs_strtgy;
+    level        = lvl;
+}
+
+// split files into chunks coded without history of each other, so they
+// can be coded in parallel; chunk is at least 1 MB and at most 4 MB, but
+// not smaller than window, so small windows lose nothing
+void CodecSettings::SetChunked() {
+    bit_chnk_cap  = bit_mtch_pos < 20 ? 20 : (bit_mtch_pos > 22 ? 22 : bit_mtch_pos);
+    byte_chnk_cap = 1 << bit_chnk_cap;
+}
+
+// keep one solid stream and search matches of each LZ block with several
+// threads before it's parsed; only hash chains stay as they are while
+// threads search them, binary tree changes with every search and levels
+// using it are left as they are, since chains lose up to 5% there;
+// chains are searched twice as deep, it's the part spread over threads
+void CodecSettings::SetParallelSearch(DWord threads) {
+    if (mtch_fndr != MFT_HC) return;
+    mtch_thrds = threads;
+    bit_runs++;
+    byte_runs = 1 << bit_runs;
+    mask_runs = byte_runs - 1;
+}
+
 // convert bit values to byte values and masks
 void CodecSettings::Set(DWord bbc, DWord blc,  DWord blh,
     DWord bml, DWord bmp, DWord bbcn,  DWord br) {
@@ -42,7 +96,7 @@ void CodecSettings::Set(DWord bbc, DWord blc,  DWord blh,
     byte_mtch_len = 1 << bml;
     mask_mtch_len = byte_mtch_len - 1;
 
-    // max LZ match pos
+    // max LZ match pos - window size
     this->bit_mtch_pos = bmp;
     byte_mtch_pos = 1 << bmp;
     mask_mtch_pos = byte_mtch_pos - 1;
@@ -57,4 +111,30 @@ void CodecSettings::Set(DWord bbc, DWord blc,  DWord blh,
     byte_runs = 1 << br;
     mask_runs = byte_runs - 1;
 
+    // hash chains by default, binary trees are slower but find longer matches
+    mtch_fndr = MFT_HC;
+
+    // greedy parsing by default, lazy and optimal ones trade speed for ratio
+    prs_strtgy = PS_GREEDY;
+
+    // plain LZ by default, ROLZ usually does better on text below level 8
+    lz_codec = CT_LZ;
+
+    // big huffman blocks are split into 4 streams decoded together, 1
+    // keeps them whole; every block remembers how it was written
+    hf_streams = 4;
+
+    // each LZ stream is coded with huffman and ANS, smaller code is kept;
+    // context model is much slower and left for high ratio mode
+    ent_codec = CT_HF | CT_ANS;
+
+    // one solid stream by default, LZ sees everything coded before
+    bit_chnk_cap = byte_chnk_cap = 0;
+
+    // matches are searched while LZ parses
+    mtch_thrds = 0;
+
+    // custom settings
+    level = 0;
+
 }
@@ -19,16 +19,27 @@ typedef uint32_t DWord;
 typedef uint64_t QWord;
 
 // enums
-enum CodecType       { CT_LZ  = 0x1, CT_HF  = 0x2 };
-enum CodecBufferType { CBT_LZ = 0x1, CBT_HF = 0x2, CBT_RAW = 0x4, CBT_EMPTY = 0x8 };
+enum CodecType       { CT_LZ  = 0x1, CT_HF  = 0x2, CT_ROLZ = 0x4, CT_ANS = 0x8, CT_CM = 0x10 };
+enum CodecBufferType { CBT_LZ = 0x1, CBT_HF = 0x2, CBT_RAW = 0x4, CBT_EMPTY = 0x8, CBT_ANS = 0x10, CBT_CM = 0x20,
+                       CBT_STORE = 0x40, CBT_PULL = 0x80 };
+enum BlockType       { BT_LZ = 0x1, BT_ENT = 0x2, BT_RAW = 0x4 };
 enum ArchiveFlags    { AF_ENCRYPT = 0x1 };
 enum FileFlags       { FF_DIR     = 0x1 };
+enum MatchFinderType { MFT_HC = 0x1, MFT_BT = 0x2 };
+enum ParseStrategy   { PS_GREEDY = 0x1, PS_LAZY = 0x2, PS_OPTIMAL = 0x4 };
 
-// byte buffer with size, cap and type
+// most symbols decoded by one pull of fused decoding
+#define CDCROUND 4096
+
+class CodecInterface;
+
+// byte buffer with size, cap and type, pulled buffer keeps coded data
+// and src is the coder which decodes it on demand
 struct CodecBuffer {
     Byte *mem;
     int   size, cap;
     CodecBufferType type;
+    CodecInterface *src;
 };
 
 // codec callback interface for monitoring compression progress
@@ -53,14 +64,29 @@ public:
 // interface of compression algorithm
 class CodecInterface {
 public:
+    virtual ~CodecInterface() {}
     virtual CodecType getCodecType()         = 0;
 	virtual void initStream(CodecStream *cs) = 0;
 	virtual int compressBlock  ()            = 0;
     virtual int decompressBlock()            = 0;
     virtual int getTotalIn()                 = 0;
     virtual int getTotalOut()                = 0;
+    // block stored or coded without this codec, codecs with history take
+    // it in the same way when compressing and decompressing
+    virtual void passBlock(Byte *, int) {}
+    // new stream which doesn't see anything coded before, codecs with
+    // history drop it in place instead of being created again
+    virtual void reset() {}
+    // fused decoding - coder opens coded buffer and returns its decoded
+    // size, then every pull decodes next round of at most CDCROUND symbols
+    // into out, 0 at the end; -1 is for coders which decode whole blocks
+    virtual int openBlock(CodecBuffer *)      { return -1; }
+    virtual int pullSymbols(Byte *)           { return 0; }
 };
 
+// compression levels
+enum CodecLevel      { CL_MIN = 1, CL_DEF = 3, CL_MAX = 9 };
+
 // codec settings used in LZ compressor
 class CodecSettings {
 public:
@@ -68,6 +94,10 @@ public:
         DWord bit_lkp_hsh, DWord bit_mtch_len,
         DWord bit_mtch_pos, DWord bit_bffr_cnt,
         DWord bit_runs);
+    void SetLevel(DWord level);
+    void SetChunked();
+    void SetParallelSearch(DWord threads);
+    DWord level;        // compression level preset used, 0 if custom
     // settings values in bits
     DWord bit_blk_cap;  // file chunk size 
     DWord bit_lkp_cap;  // lookup table size 
@@ -75,7 +105,15 @@ public:
     DWord bit_mtch_len; // max match lenght size
     DWord bit_mtch_pos; // max match position size
     DWord bit_bffr_cnt; // working buffer count
-    DWord bit_runs;
+    DWord bit_runs;     // match finder search depth
+    MatchFinderType mtch_fndr; // hash chain or binary tree match finder
+    ParseStrategy  prs_strtgy; // how LZ chooses between literals and matches
+    CodecType        lz_codec; // plain LZ or reduced offset LZ
+    DWord          hf_streams; // huffman streams big blocks are split into
+    DWord           ent_codec; // entropy coders tried on LZ streams, CT_HF/ANS/CM
+    DWord        bit_chnk_cap; // size of independently coded chunks in bits, 0 for solid stream
+    DWord       byte_chnk_cap;
+    DWord          mtch_thrds; // threads searching matches of LZ block ahead of parser, 0 for none
     // in bytes
     DWord byte_blk_cap, byte_lkp_cap, byte_lkp_hsh,
         byte_mtch_len, byte_mtch_pos, byte_bffr_cnt,
@@ -94,6 +132,19 @@ struct ArchiveHeader {
     DWord a_flgs;     // flags
     QWord a_unc_size; // archive uncompressed size
     QWord a_cmp_size; // archive compressed size
+    DWord a_ver;      // format version
+    DWord a_level;    // compression level
+    DWord a_blk_cap;  // codec settings, in bits except hash length in bytes
+    DWord a_lkp_cap;
+    DWord a_lkp_hsh;
+    DWord a_mtch_len;
+    DWord a_mtch_pos;
+    DWord a_bffr_cnt;
+    DWord a_runs;
+    DWord a_mtch_fndr;
+    DWord a_prs_strtgy;
+    DWord a_lz_codec;
+    DWord a_chnk_cap; // chunk size in bits, 0 if file is one solid stream
 };
 
 // file in archive header
@@ -109,6 +160,14 @@ struct FileHeader {
     DWord f_cnt_hsh;  // FNV hash
 };
 
+// chunk in index which follows data of chunked file, chunks are in file
+// order so their sizes tell where each starts in archive and in file;
+// index is followed by number of chunks
+struct ChunkHeader {
+    DWord c_cmp_size; // compressed and decompressed sizes
+    DWord c_dcm_size;
+};
+
 } // namespace
 
 #endif // LZHX_TYPES_H
@@ -6,6 +6,7 @@
 
 // c
 #include <cassert>
+#include <cstring>
 #include <stdlib.h>
 
 // stl
@@ -58,6 +59,33 @@ Word LZHX::read16From8Buf(Byte *buf) {
 	return i;
 }
 
+// byte histogram, four of them are counted in turns so increments of the
+// same byte following each other don't wait for one another
+void LZHX::countBytes(Byte *buf, int size, int *freq) {
+	int hist[4][256], i(0);
+	memset(hist, 0, sizeof(hist));
+	for (; i + 4 <= size; i += 4) {
+		hist[0][buf[i]]++;
+		hist[1][buf[i + 1]]++;
+		hist[2][buf[i + 2]]++;
+		hist[3][buf[i + 3]]++;
+	}
+	for (; i < size; i++) hist[0][buf[i]]++;
+	for (int s = 0; s < 256; s++)
+		freq[s] = hist[0][s] + hist[1][s] + hist[2][s] + hist[3][s];
+}
+
+// FNV-1a hash of bytes; archive hash of solid file xors signed chars, so
+// the two differ for bytes from 0x80 up
+DWord LZHX::fnvHash(const Byte *buf, int size) {
+	DWord h = 0x811C9DC5;
+	for (int i = 0; i < size; i++) {
+		h ^= buf[i];
+		h *= 0x1000193;
+	}
+	return h;
+}
+
 // console stuff
 void LZHX::setConsoleTextRed() {
     SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE),
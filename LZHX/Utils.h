@@ -27,6 +27,12 @@ int   write16To8Buf (Byte *buf, Word  i);
 DWord read32From8Buf(Byte *buf);
 Word  read16From8Buf(Byte *buf);
 
+// byte histogram
+void  countBytes(Byte *buf, int size, int *freq);
+
+// FNV-1a hash of buffer
+DWord fnvHash(const Byte *buf, int size);
+
 // console
 void setConsoleTextRed();
 void setConsoleTextNormal();